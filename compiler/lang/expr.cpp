@@ -1339,6 +1339,16 @@ Value *ArrayContainsExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
 
   Value *val = this->val->codegen(base, block);
   Value *arr = this->arr->codegen(base, block);
+
+  if (auto *func = dynamic_cast<Func *>(base)) {
+    if (func->hasAttribute("prefetch") &&
+        arrType->magicOut("__prefetch__", {valType}, /*nullOnMissing=*/true)) {
+      arrType->callMagic("__prefetch__", {valType}, arr, {val}, block,
+                         getTryCatch());
+      func->codegenYield(nullptr, nullptr, block, true);
+    }
+  }
+
   return arrType->callMagic("__contains__", {valType}, arr, {val}, block,
                             getTryCatch());
 }
@@ -1698,6 +1708,10 @@ static bool isLiteralNegOne(Expr *e) {
   return false;
 }
 
+static bool isLiteralNone(Expr *e) {
+  return dynamic_cast<NoneExpr *>(e) != nullptr;
+}
+
 Value *CallExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
   types::Type *type = getType(); // validates call
   std::vector<Expr *> args = rectifyCallArgs(func, this->args, names);
@@ -1728,7 +1742,7 @@ Value *CallExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
               splice_fwd: bool = False,
               splice_rev: bool = False,
               splice_flank: bool = False,
-              glob: bool = False):
+              aligner: Aligner = None):
     */
   // not all are supported for inter-sequence alignment!
   std::vector<std::string> argNames = {"",           "",
@@ -1741,7 +1755,8 @@ Value *CallExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
                                        "approx_max", "approx_drop",
                                        "",           "",
                                        "splice",     "splice_fwd",
-                                       "splice_rev", "splice_flank"};
+                                       "splice_rev", "splice_flank",
+                                       "aligner"};
   auto *baseFunc = dynamic_cast<Func *>(base);
   if (baseFunc && baseFunc->hasAttribute("inter_align")) {
     if (auto *elemExpr = dynamic_cast<GetElemExpr *>(func)) {
@@ -1776,6 +1791,8 @@ Value *CallExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
               bool unsupported = false;
               if (argNames[i] == "gapo2" || argNames[i] == "gape2")
                 unsupported = !isLiteralNegOne(args[i]);
+              else if (argNames[i] == "aligner")
+                unsupported = !isLiteralNone(args[i]);
               else
                 unsupported = !isLiteralFalse(args[i]);
               if (unsupported)
@@ -1,4 +1,5 @@
 #include "lang/seq.h"
+#include <algorithm>
 
 using namespace seq;
 using namespace llvm;
@@ -43,7 +44,7 @@ Func::Func()
       outType(types::Void), outType0(types::Void), defaultArgs(),
       scope(new Block()), argNames(), argVars(), attributes(),
       parentFunc(nullptr), ret(nullptr), yield(nullptr), prefetch(false),
-      interAlign(false), resolved(false), cache(), gen(false), promise(nullptr),
+      interAlign(false), parallelGrain(0), resolved(false), cache(), gen(false), promise(nullptr),
       handle(nullptr), cleanup(nullptr), suspend(nullptr) {
   if (!this->argNames.empty())
     assert(this->argNames.size() == this->inTypes.size());
@@ -225,7 +226,28 @@ void Func::sawYield(Yield *yield) {
   outType0 = types::GenType::get(outType0);
 }
 
+// Splits an attribute like "prefetch(32)" into its name and argument;
+// returns -1 as the argument if there is none.
+static long parseAttribute(std::string &attr, const SrcInfo &src) {
+  auto lp = attr.find('(');
+  if (lp == std::string::npos || attr.back() != ')')
+    return -1;
+  std::string arg = attr.substr(lp + 1, attr.size() - lp - 2);
+  attr = attr.substr(0, lp);
+  arg.erase(std::remove(arg.begin(), arg.end(), '_'), arg.end());
+  try {
+    return std::stol(arg, nullptr, 0);
+  } catch (std::exception &) {
+    throw exc::SeqException("invalid argument to attribute '" + attr + "'",
+                            src);
+  }
+}
+
 void Func::addAttribute(std::string attr) {
+  long arg = parseAttribute(attr, getSrcInfo());
+  if (arg >= 0 && attr != "prefetch" && attr != "parallel")
+    throw exc::SeqException("attribute '" + attr + "' takes no arguments",
+                            getSrcInfo());
   attributes.push_back(attr);
 
   if (attr == "builtin") {
@@ -238,12 +260,26 @@ void Func::addAttribute(std::string attr) {
           "function cannot perform both prefetch and inter-sequence alignment",
           getSrcInfo());
 
+    // optional argument is the width of the pipeline's coroutine scheduler
+    if (arg >= 0 && (arg < 1 || arg > PipeExpr::MAX_SCHED_WIDTH_PREFETCH ||
+                     (arg & (arg - 1)) != 0))
+      throw exc::SeqException(
+          "prefetch width must be a power of two no greater than " +
+              std::to_string(PipeExpr::MAX_SCHED_WIDTH_PREFETCH),
+          getSrcInfo());
+
     prefetch = true;
     gen = true;
-    outType =
+    auto *genType =
         types::GenType::get(outType, types::GenType::GenTypeKind::PREFETCH);
-    outType0 =
+    auto *genType0 =
         types::GenType::get(outType0, types::GenType::GenTypeKind::PREFETCH);
+    if (arg > 0) {
+      genType->setPrefetchWidth((unsigned)arg);
+      genType0->setPrefetchWidth((unsigned)arg);
+    }
+    outType = genType;
+    outType0 = genType0;
   } else if (attr == "inter_align") {
     if (interAlign)
       return;
@@ -262,6 +298,14 @@ void Func::addAttribute(std::string attr) {
         types::GenType::get(yieldType, types::GenType::GenTypeKind::INTERALIGN);
     outType0 =
         types::GenType::get(yieldType, types::GenType::GenTypeKind::INTERALIGN);
+  } else if (attr == "parallel") {
+    // argument is the grain size of the function's parallel pipelines
+    if (arg < 1 || arg > PipeExpr::MAX_PARALLEL_GRAIN)
+      throw exc::SeqException(
+          "parallel grain size must be between 1 and " +
+              std::to_string(PipeExpr::MAX_PARALLEL_GRAIN),
+          getSrcInfo());
+    parallelGrain = (unsigned)arg;
   }
 }
 
@@ -275,6 +319,8 @@ bool Func::hasAttribute(const std::string &attr) {
   return false;
 }
 
+unsigned Func::getParallelGrain() { return parallelGrain; }
+
 /*
  * Mangling rules:
  *   - Base function name is mangled as "<name>[<generic type 1>,<generic type
@@ -749,6 +795,7 @@ Func *Func::clone(Generic *ref) {
     x->yield = yield->clone(ref);
   x->prefetch = prefetch;
   x->interAlign = interAlign;
+  x->parallelGrain = parallelGrain;
   x->gen = gen;
   x->setSrcInfo(getSrcInfo());
   return x;
@@ -102,6 +102,10 @@ private:
   /// Whether this function performs inter-sequence alignment
   bool interAlign;
 
+  /// Number of consecutive generator outputs each task of a parallel
+  /// pipeline in this function processes, or 0 to size chunks adaptively
+  unsigned parallelGrain;
+
   /// Whether types in this function have been resolved
   bool resolved;
 
@@ -154,6 +158,7 @@ public:
   void addAttribute(std::string attr);
   std::vector<std::string> getAttributes();
   bool hasAttribute(const std::string &attr);
+  unsigned getParallelGrain();
 
   void resolveTypes() override;
   void codegen(llvm::Module *module) override;
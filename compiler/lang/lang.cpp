@@ -441,14 +441,11 @@ StructType *TryCatch::getExcType(LLVMContext &context) {
                          IntegerType::getInt8PtrTy(context));
 }
 
-GlobalVariable *TryCatch::getTypeIdxVar(Module *module,
-                                        const std::string &name) {
+static GlobalVariable *makeTypeIdxVar(Module *module,
+                                      const std::string &typeVarName, int idx) {
   LLVMContext &context = module->getContext();
   auto *typeInfoType = getTypeInfoType(context);
-  const std::string typeVarName =
-      "seq.typeidx." + (name.empty() ? "<all>" : name);
   GlobalVariable *tidx = module->getGlobalVariable(typeVarName);
-  int idx = types::Type::getID(name);
   if (!tidx)
     tidx = new GlobalVariable(
         *module, typeInfoType, true, GlobalValue::PrivateLinkage,
@@ -459,11 +456,23 @@ GlobalVariable *TryCatch::getTypeIdxVar(Module *module,
   return tidx;
 }
 
+GlobalVariable *TryCatch::getTypeIdxVar(Module *module,
+                                        const std::string &name) {
+  return makeTypeIdxVar(module,
+                        "seq.typeidx." + (name.empty() ? "<all>" : name),
+                        types::Type::getID(name));
+}
+
 GlobalVariable *TryCatch::getTypeIdxVar(Module *module,
                                         types::Type *catchType) {
   return getTypeIdxVar(module, catchType ? catchType->getName() : "");
 }
 
+GlobalVariable *TryCatch::getTerminateIdxVar(Module *module) {
+  return makeTypeIdxVar(module, "seq.typeidx.<terminate>",
+                        SEQ_EXC_TYPE_TERMINATE);
+}
+
 void TryCatch::resolveTypes() {
   scope->resolveTypes();
   for (auto *block : catchBlocks)
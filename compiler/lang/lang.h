@@ -171,6 +171,7 @@ public:
                                              const std::string &name);
   static llvm::GlobalVariable *getTypeIdxVar(llvm::Module *module,
                                              types::Type *catchType);
+  static llvm::GlobalVariable *getTerminateIdxVar(llvm::Module *module);
 };
 
 class Throw : public Stmt {
@@ -1,4 +1,6 @@
 #include "lang/seq.h"
+#include <algorithm>
+#include <map>
 #include <queue>
 #include <utility>
 
@@ -22,17 +24,66 @@ void PipeExpr::resolveTypes() {
     stage->resolveTypes();
 }
 
+// Per-thread prefetch schedulers keep their counters a cache line apart.
+static const unsigned PREFETCH_COUNTER_STRIDE = 8;
+
+#if !SEQ_HAS_TAPIR
+/*
+ * Without Tapir, the blocks making up a parallel stage are delimited by
+ * calls to these two markers (with a matching ID), and the stage is later
+ * outlined into a task function that is spawned on the runtime's scheduler;
+ * see PipeExpr::outlineParallelStages().
+ */
+static const char *TASK_BEGIN = "seq.task.begin";
+static const char *TASK_END = "seq.task.end";
+
+static unsigned beginTask(Value *group, BasicBlock *block,
+                          BasicBlock *detach) {
+  static unsigned nextTaskID = 0;
+  const unsigned id = ++nextTaskID;
+  LLVMContext &context = block->getContext();
+  Module *module = block->getModule();
+  auto *begin = cast<Function>(module->getOrInsertFunction(
+      TASK_BEGIN, Type::getVoidTy(context), seqIntLLVM(context)->getPointerTo(),
+      seqIntLLVM(context)));
+  begin->setDoesNotThrow();
+
+  IRBuilder<> builder(block);
+  builder.CreateBr(detach);
+  builder.SetInsertPoint(detach);
+  builder.CreateCall(begin, {group, ConstantInt::get(seqIntLLVM(context), id)});
+  return id;
+}
+
+static void endTask(unsigned id, BasicBlock *block, BasicBlock *cont) {
+  LLVMContext &context = block->getContext();
+  Module *module = block->getModule();
+  auto *end = cast<Function>(module->getOrInsertFunction(
+      TASK_END, Type::getVoidTy(context), seqIntLLVM(context)));
+  end->setDoesNotThrow();
+
+  IRBuilder<> builder(block);
+  builder.CreateCall(end, ConstantInt::get(seqIntLLVM(context), id));
+  builder.CreateBr(cont);
+}
+#endif
+
 // Some useful info for codegen'ing the "drain" step after prefetch transform.
 struct DrainState {
   Value *states; // coroutine states buffer
   Value *filled; // how many coroutines have been added (alloca'd)
 
+  // prefetch-specific fields
+  Value *threads; // number of per-thread schedulers, or null if just one
+  unsigned width; // scheduler width
+
   // inter-align-specific fields
   Value *statesTemp;
   Value *pairs;
   Value *pairsTemp;
   Value *bufRef;
   Value *bufQer;
+  Value *bufLong;
   Value *params;
   Value *hist;
 
@@ -41,9 +92,10 @@ struct DrainState {
   std::queue<bool> parallel;
 
   DrainState()
-      : states(nullptr), filled(nullptr), statesTemp(nullptr), pairs(nullptr),
-        pairsTemp(nullptr), bufRef(nullptr), bufQer(nullptr), params(nullptr),
-        hist(nullptr), type(nullptr), stages(), parallel() {}
+      : states(nullptr), filled(nullptr), threads(nullptr), width(0),
+        statesTemp(nullptr), pairs(nullptr),
+        pairsTemp(nullptr), bufRef(nullptr), bufQer(nullptr), bufLong(nullptr),
+        params(nullptr), hist(nullptr), type(nullptr), stages(), parallel() {}
 };
 
 struct seq::PipeExpr::PipelineCodegenState {
@@ -225,6 +277,43 @@ static void applyCanonicalKmerOptimization(std::vector<Expr *> &stages,
   parallel = parallelNew;
 }
 
+/*
+ * Partitioned input optimization turns "x ||> f" for inputs that can be split
+ * into independently parsable ranges (i.e. that define __partitions__, like
+ * FASTQ and FASTA readers) into "_partitions(x) ||> _partition_iter ||> f", so
+ * that each parallel task parses its own part of the input rather than all
+ * parsing happening serially on the thread that spawns the tasks. Whether x
+ * can actually be split is only known at runtime (it may be stdin or plain
+ * gzip, say); if not, x itself is its only partition, and f is still spawned
+ * per record as in the original pipeline.
+ */
+static void applyPartitionedInputOptimization(std::vector<Expr *> &stages,
+                                              std::vector<bool> &parallel) {
+  if (stages.size() < 2 || !parallel[0])
+    return;
+
+  types::Type *type = stages[0]->getType();
+  if (type->asGen() || !type->hasMethod("__partitions__"))
+    return;
+
+  std::vector<Expr *> stagesNew;
+  std::vector<bool> parallelNew;
+  stagesNew.push_back(
+      new CallExpr(new FuncExpr(Func::getBuiltin("_partitions")), {stages[0]}));
+  stagesNew.back()->resolveTypes();
+  parallelNew.push_back(true);
+  stagesNew.push_back(new FuncExpr(Func::getBuiltin("_partition_iter")));
+  stagesNew.back()->resolveTypes();
+  parallelNew.push_back(true);
+
+  for (unsigned i = 1; i < stages.size(); i++) {
+    stagesNew.push_back(stages[i]);
+    parallelNew.push_back(parallel[i]);
+  }
+  stages = stagesNew;
+  parallel = parallelNew;
+}
+
 // make sure params are globals or literals, since codegen'ing in function entry
 // block
 template <typename E = IntExpr>
@@ -339,20 +428,83 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
      * this point in the pipeline, as well as a "drain" loop after
      * the pipeline to complete any remaining calls.
      */
-    if (parallelize || state.inParallel)
+    bool parallelAfter = parallelize;
+    for (auto rest = state.parallel; !rest.empty(); rest.pop())
+      parallelAfter = parallelAfter || rest.front();
+    if (parallelAfter)
       throw exc::SeqException(
-          "parallel prefetch transformation currently not supported");
-
-    BasicBlock *preamble = base->getPreamble();
-    IRBuilder<> builder(preamble);
-    Value *states = makeAlloca(builder.getInt8PtrTy(), preamble,
-                               PipeExpr::SCHED_WIDTH_PREFETCH);
-    Value *next = makeAlloca(seqIntLLVM(context), preamble);
-    Value *filled = makeAlloca(seqIntLLVM(context), preamble);
+          "parallel pipeline stage cannot follow prefetch function");
+
+    const unsigned W = genType->getPrefetchWidth()
+                           ? genType->getPrefetchWidth()
+                           : PipeExpr::SCHED_WIDTH_PREFETCH;
+    Value *states = nullptr;
+    Value *next = nullptr;
+    Value *filled = nullptr;
+    Value *threads = nullptr;
+    IRBuilder<> builder(entry);
+
+    if (state.inParallel) {
+      /*
+       * Each thread gets its own scheduler: W coroutine slots plus a cache
+       * line holding its "next" and "filled" counters. Tasks don't migrate
+       * between threads and (as no parallel stages follow) don't reach a
+       * task scheduling point while using their thread's scheduler.
+       */
+#if SEQ_HAS_TAPIR
+      const char *maxThreadsName = "omp_get_max_threads";
+      const char *threadNumName = "omp_get_thread_num";
+#else
+      const char *maxThreadsName = "seq_sched_num_threads";
+      const char *threadNumName = "seq_sched_thread_num";
+#endif
+      auto *maxThreadsFunc = cast<Function>(
+          module->getOrInsertFunction(maxThreadsName, builder.getInt32Ty()));
+      maxThreadsFunc->setDoesNotThrow();
+      auto *threadNumFunc = cast<Function>(
+          module->getOrInsertFunction(threadNumName, builder.getInt32Ty()));
+      threadNumFunc->setDoesNotThrow();
+      Function *alloc = makeAllocFunc(module, /*atomic=*/false);
+      const unsigned wordSize = seqIntLLVM(context)->getBitWidth() / 8;
+
+      threads = builder.CreateZExt(builder.CreateCall(maxThreadsFunc),
+                                   seqIntLLVM(context));
+      Value *statesAll = builder.CreateCall(
+          alloc, builder.CreateMul(threads, builder.getInt64(W * wordSize)));
+      statesAll = builder.CreateBitCast(
+          statesAll, builder.getInt8PtrTy()->getPointerTo());
+      Value *counters = builder.CreateCall(
+          alloc, builder.CreateMul(
+                     threads, builder.getInt64(PREFETCH_COUNTER_STRIDE *
+                                               wordSize)));
+      counters = builder.CreateBitCast(
+          counters, seqIntLLVM(context)->getPointerTo());
+
+      // drain step indexes per-thread schedulers from the start
+      state.drain.states = statesAll;
+      state.drain.filled = builder.CreateGEP(counters, oneLLVM(context));
 
-    builder.SetInsertPoint(entry);
-    builder.CreateStore(zeroLLVM(context), next);
-    builder.CreateStore(zeroLLVM(context), filled);
+      builder.SetInsertPoint(state.block);
+      Value *tid = builder.CreateZExt(builder.CreateCall(threadNumFunc),
+                                      seqIntLLVM(context));
+      states = builder.CreateGEP(
+          statesAll, builder.CreateMul(tid, builder.getInt64(W)));
+      next = builder.CreateGEP(
+          counters,
+          builder.CreateMul(tid, builder.getInt64(PREFETCH_COUNTER_STRIDE)));
+      filled = builder.CreateGEP(next, oneLLVM(context));
+    } else {
+      BasicBlock *preamble = base->getPreamble();
+      IRBuilder<> preambleBuilder(preamble);
+      states = makeAlloca(preambleBuilder.getInt8PtrTy(), preamble, W);
+      next = makeAlloca(seqIntLLVM(context), preamble);
+      filled = makeAlloca(seqIntLLVM(context), preamble);
+
+      builder.CreateStore(zeroLLVM(context), next);
+      builder.CreateStore(zeroLLVM(context), filled);
+      state.drain.states = states;
+      state.drain.filled = filled;
+    }
 
     BasicBlock *notFull = BasicBlock::Create(context, "not_full", func);
     BasicBlock *full = BasicBlock::Create(context, "full", func);
@@ -360,8 +512,7 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
 
     builder.SetInsertPoint(state.block);
     Value *N = builder.CreateLoad(filled);
-    Value *M =
-        ConstantInt::get(seqIntLLVM(context), PipeExpr::SCHED_WIDTH_PREFETCH);
+    Value *M = ConstantInt::get(seqIntLLVM(context), W);
     Value *cond = builder.CreateICmpSLT(N, M);
     builder.CreateCondBr(cond, notFull, full);
 
@@ -406,8 +557,8 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
         state.type->is(types::Void) ? nullptr : genType->promise(gen, genDone);
 
     // store the current state for the drain step:
-    state.drain.states = states;
-    state.drain.filled = filled;
+    state.drain.threads = threads;
+    state.drain.width = W;
     state.drain.type = genType;
     state.drain.stages = state.stages;
     state.drain.parallel = state.parallel;
@@ -430,9 +581,8 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
 
     builder.SetInsertPoint(genNotDone);
     nextVal = builder.CreateAdd(nextVal, oneLLVM(context));
-    nextVal = builder.CreateAnd(
-        nextVal, ConstantInt::get(seqIntLLVM(context),
-                                  PipeExpr::SCHED_WIDTH_PREFETCH - 1));
+    nextVal =
+        builder.CreateAnd(nextVal, ConstantInt::get(seqIntLLVM(context), W - 1));
     builder.CreateStore(nextVal, next);
     builder.CreateBr(full0);
 
@@ -489,6 +639,8 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
     Value *statesSize = builder.getInt64(genType->size(module) * W);
     Value *bufRefSize = builder.getInt64(LEN_LIMIT * W);
     Value *bufQerSize = builder.getInt64(LEN_LIMIT * W);
+    Value *bufLongSize = builder.getInt64(
+        types::PtrType::get(types::Byte)->size(module) * W);
     Value *pairsSize = builder.getInt64(pairType->size(module) * W);
     Value *histSize = builder.getInt64((MAX_SEQ_LEN8 + MAX_SEQ_LEN16 + 32) * 4);
     Value *states = builder.CreateCall(alloc, statesSize);
@@ -499,6 +651,9 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
         statesTemp, genType->getLLVMType(context)->getPointerTo());
     Value *bufRef = builder.CreateCall(allocAtomic, bufRefSize);
     Value *bufQer = builder.CreateCall(allocAtomic, bufQerSize);
+    Value *bufLong = builder.CreateCall(alloc, bufLongSize);
+    bufLong = builder.CreateBitCast(
+        bufLong, builder.getInt8PtrTy()->getPointerTo());
     Value *pairs = builder.CreateCall(alloc, pairsSize);
     pairs = builder.CreateBitCast(
         pairs, pairType->getLLVMType(context)->getPointerTo());
@@ -519,8 +674,8 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
     builder.CreateCondBr(cond, notFull0, full);
 
     builder.SetInsertPoint(full);
-    N = builder.CreateCall(flush, {pairs, bufRef, bufQer, states, N, params,
-                                   hist, pairsTemp, statesTemp});
+    N = builder.CreateCall(flush, {pairs, bufRef, bufQer, bufLong, states, N,
+                                   params, hist, pairsTemp, statesTemp});
     builder.CreateStore(N, filled);
     cond = builder.CreateICmpSLT(N, M);
     builder.CreateCondBr(cond, notFull0, full); // keep flushing while full
@@ -533,6 +688,7 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
     state.drain.pairsTemp = pairsTemp;
     state.drain.bufRef = bufRef;
     state.drain.bufQer = bufQer;
+    state.drain.bufLong = bufLong;
     state.drain.params = params;
     state.drain.hist = hist;
     state.drain.type = genType;
@@ -542,11 +698,195 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
     builder.SetInsertPoint(notFull);
     N = builder.CreateLoad(filled);
     N = builder.CreateCall(queue,
-                           {task, pairs, bufRef, bufQer, states, N, params});
+                           {task, pairs, bufRef, bufQer, bufLong, states, N,
+                            params});
     builder.CreateStore(N, filled);
     builder.CreateBr(exit);
     state.block = exit;
     return nullptr;
+  } else if (genType && stage != state.stages.back() && parallelize) {
+    /*
+     * Generator followed by a parallel pipe -- create implicit for-loop
+     *
+     * Spawning a task per generated value costs more than most stages do
+     * with it, so values are collected into chunks and each task runs the
+     * rest of the pipeline over a whole chunk. The chunk size ("grain") is
+     * fixed if the enclosing function is annotated with @parallel(N);
+     * otherwise it starts at 1 and the runtime adjusts it after each spawn,
+     * based on how long tasks have taken per value so far.
+     */
+    Value *gen = state.val;
+    types::Type *valType = genType->getBaseType(0);
+    const bool hasVal = !valType->is(types::Void);
+    auto *baseFunc = dynamic_cast<Func *>(base);
+    const unsigned fixedGrain = baseFunc ? baseFunc->getParallelGrain() : 0;
+    IntegerType *intType = seqIntLLVM(context);
+    IRBuilder<> builder(entry);
+
+    // per-pipeline timing: total nanoseconds and values processed by tasks
+    Value *stats = nullptr;
+    Function *timeFunc = nullptr;
+    if (!fixedGrain) {
+      stats = makeAlloca(intType, base->getPreamble(), 2);
+      builder.CreateStore(zeroLLVM(context), stats);
+      builder.CreateStore(zeroLLVM(context),
+                          builder.CreateGEP(stats, oneLLVM(context)));
+      timeFunc = cast<Function>(
+          module->getOrInsertFunction("seq_time_monotonic", intType));
+      timeFunc->setDoesNotThrow();
+    }
+
+    Function *alloc = makeAllocFunc(module, valType->isAtomic());
+    Type *bufType =
+        hasVal ? valType->getLLVMType(context)->getPointerTo() : nullptr;
+    auto allocChunk = [&](Value *grain) -> Value * {
+      if (!hasVal)
+        return nullptr;
+      Value *size = builder.CreateMul(
+          grain, ConstantInt::get(intType, valType->size(module)));
+      return builder.CreateBitCast(builder.CreateCall(alloc, size), bufType);
+    };
+
+    BasicBlock *preheader = state.block;
+    builder.SetInsertPoint(preheader);
+    Value *grain0 = ConstantInt::get(intType, fixedGrain ? fixedGrain : 1);
+    Value *buf0 = allocChunk(grain0);
+    BasicBlock *loop = BasicBlock::Create(context, "pipe", func);
+    BasicBlock *loop0 = loop;
+    builder.CreateBr(loop);
+
+    // current chunk, number of values in it and its capacity
+    builder.SetInsertPoint(loop);
+    PHINode *buf = hasVal ? builder.CreatePHI(bufType, 3) : nullptr;
+    PHINode *count = builder.CreatePHI(intType, 3);
+    PHINode *grain = builder.CreatePHI(intType, 3);
+    if (buf)
+      buf->addIncoming(buf0, preheader);
+    count->addIncoming(zeroLLVM(context), preheader);
+    grain->addIncoming(grain0, preheader);
+
+    if (tc) {
+      BasicBlock *normal = BasicBlock::Create(context, "normal", func);
+      BasicBlock *unwind = tc->getExceptionBlock();
+      genType->resume(gen, loop, normal, unwind);
+      loop = normal;
+    } else {
+      genType->resume(gen, loop, nullptr, nullptr);
+    }
+
+    Value *done = genType->done(gen, loop);
+    BasicBlock *body = BasicBlock::Create(context, "body", func);
+    BasicBlock *last = BasicBlock::Create(context, "last", func);
+    BasicBlock *spawn = BasicBlock::Create(context, "spawn", func);
+    BasicBlock *cleanup = BasicBlock::Create(context, "cleanup", func);
+    builder.SetInsertPoint(loop);
+    builder.CreateCondBr(done, last, body);
+
+    // add the next value to the chunk, and spawn it once it's full
+    Value *val = hasVal ? genType->promise(gen, body) : nullptr;
+    builder.SetInsertPoint(body);
+    if (buf)
+      builder.CreateStore(val, builder.CreateGEP(buf, count));
+    Value *count1 = builder.CreateAdd(count, oneLLVM(context));
+    builder.CreateCondBr(builder.CreateICmpSGE(count1, grain), spawn, loop0);
+    if (buf)
+      buf->addIncoming(buf, body);
+    count->addIncoming(count1, body);
+    grain->addIncoming(grain, body);
+
+    // spawn what's left once the generator is done
+    builder.SetInsertPoint(last);
+    builder.CreateCondBr(builder.CreateICmpSGT(count, zeroLLVM(context)), spawn,
+                         cleanup);
+
+    builder.SetInsertPoint(spawn);
+    PHINode *n = builder.CreatePHI(intType, 2);
+    n->addIncoming(count1, body);
+    n->addIncoming(count, last);
+    PHINode *isLast = builder.CreatePHI(builder.getInt1Ty(), 2);
+    isLast->addIncoming(builder.getFalse(), body);
+    isLast->addIncoming(builder.getTrue(), last);
+
+    BasicBlock *detach = BasicBlock::Create(context, "detach", func);
+    BasicBlock *cont = BasicBlock::Create(context, "continue", func);
+#if SEQ_HAS_TAPIR
+    BasicBlock *unwind = tc ? tc->getExceptionBlock() : nullptr;
+    if (unwind)
+      builder.CreateDetach(detach, cont, unwind, syncReg);
+    else
+      builder.CreateDetach(detach, cont, syncReg);
+#else
+    const unsigned task = beginTask(syncReg, spawn, detach);
+#endif
+
+    // task: run the rest of the pipeline on each value in the chunk
+    builder.SetInsertPoint(detach);
+    Value *startTime = stats ? builder.CreateCall(timeFunc) : nullptr;
+    BasicBlock *chunk = BasicBlock::Create(context, "chunk", func);
+    builder.CreateBr(chunk);
+    builder.SetInsertPoint(chunk);
+    PHINode *k = builder.CreatePHI(intType, 2);
+    k->addIncoming(zeroLLVM(context), detach);
+
+    state.block = chunk;
+    state.type = valType;
+    state.val = buf ? builder.CreateLoad(builder.CreateGEP(buf, k)) : nullptr;
+
+    // save and restore state to codegen next stage
+    bool oldInLoop = state.inLoop;
+    bool oldInParallel = state.inParallel;
+    state.inLoop = true;
+    state.inParallel = true;
+    codegenPipe(base, state);
+    state.inLoop = oldInLoop;
+    state.inParallel = oldInParallel;
+
+    BasicBlock *chunkDone = BasicBlock::Create(context, "chunk_done", func);
+    builder.SetInsertPoint(state.block);
+    Value *k1 = builder.CreateAdd(k, oneLLVM(context));
+    k->addIncoming(k1, state.block);
+    builder.CreateCondBr(builder.CreateICmpSLT(k1, n), chunk, chunkDone);
+
+    builder.SetInsertPoint(chunkDone);
+    if (stats) {
+      auto *chunkDoneFunc = cast<Function>(module->getOrInsertFunction(
+          "seq_sched_chunk_done", builder.getVoidTy(), intType->getPointerTo(),
+          intType, intType));
+      chunkDoneFunc->setDoesNotThrow();
+      builder.CreateCall(chunkDoneFunc, {stats, n, startTime});
+    }
+#if SEQ_HAS_TAPIR
+    builder.CreateReattach(cont, syncReg);
+#else
+    endTask(task, chunkDone, cont);
+#endif
+
+    // start a new chunk, resizing it if the grain is adaptive
+    BasicBlock *next = BasicBlock::Create(context, "next", func);
+    builder.SetInsertPoint(cont);
+    builder.CreateCondBr(isLast, cleanup, next);
+
+    builder.SetInsertPoint(next);
+    Value *nextGrain = grain;
+    if (stats) {
+      auto *grainFunc = cast<Function>(module->getOrInsertFunction(
+          "seq_sched_grain", intType, intType->getPointerTo(), intType));
+      grainFunc->setDoesNotThrow();
+      nextGrain = builder.CreateCall(grainFunc, {stats, grain});
+    }
+    Value *nextBuf = allocChunk(nextGrain);
+    builder.CreateBr(loop0);
+    if (buf)
+      buf->addIncoming(nextBuf, next);
+    count->addIncoming(zeroLLVM(context), next);
+    grain->addIncoming(nextGrain, next);
+
+    genType->destroy(gen, cleanup);
+    BasicBlock *exit = BasicBlock::Create(context, "exit", func);
+    builder.SetInsertPoint(cleanup);
+    builder.CreateBr(exit);
+    state.block = exit;
+    return nullptr;
   } else if (genType && stage != state.stages.back()) {
     /*
      * Plain generator -- create implicit for-loop
@@ -579,42 +919,17 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
                     ? nullptr
                     : genType->promise(gen, state.block);
 
-#if SEQ_HAS_TAPIR
-    if (parallelize) {
-      BasicBlock *unwind = tc ? tc->getExceptionBlock() : nullptr;
-      BasicBlock *detach = BasicBlock::Create(context, "detach", func);
-      builder.SetInsertPoint(state.block);
-      if (unwind)
-        builder.CreateDetach(detach, loop0, unwind, syncReg);
-      else
-        builder.CreateDetach(detach, loop0, syncReg);
-      state.block = detach;
-    }
-#endif
-
     BasicBlock *cleanup = BasicBlock::Create(context, "cleanup", func);
     branch->setSuccessor(0, cleanup);
 
     // save and restore state to codegen next stage
     bool oldInLoop = state.inLoop;
-    bool oldInParallel = state.inParallel;
     state.inLoop = true;
-    state.inParallel = parallelize;
     codegenPipe(base, state);
     state.inLoop = oldInLoop;
-    state.inParallel = oldInParallel;
 
     builder.SetInsertPoint(state.block);
-
-#if SEQ_HAS_TAPIR
-    if (parallelize) {
-      builder.CreateReattach(loop0, syncReg);
-    } else {
-#endif
-      builder.CreateBr(loop0);
-#if SEQ_HAS_TAPIR
-    }
-#endif
+    builder.CreateBr(loop0);
 
     genType->destroy(gen, cleanup);
     BasicBlock *exit = BasicBlock::Create(context, "exit", func);
@@ -626,21 +941,24 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
     /*
      * Simple function -- just a plain call
      */
-#if SEQ_HAS_TAPIR
     if (parallelize) {
       if (!state.inLoop)
         throw exc::SeqException(
             "parallel pipeline stage is not preceded by generator stage");
 
-      BasicBlock *unwind = tc ? tc->getExceptionBlock() : nullptr;
       BasicBlock *detach = BasicBlock::Create(context, "detach", func);
       BasicBlock *cont = BasicBlock::Create(context, "continue", func);
 
+#if SEQ_HAS_TAPIR
+      BasicBlock *unwind = tc ? tc->getExceptionBlock() : nullptr;
       IRBuilder<> builder(state.block);
       if (unwind)
         builder.CreateDetach(detach, cont, unwind, syncReg);
       else
         builder.CreateDetach(detach, cont, syncReg);
+#else
+      const unsigned task = beginTask(syncReg, state.block, detach);
+#endif
 
       bool oldInParallel = state.inParallel;
       state.inParallel = true;
@@ -648,13 +966,16 @@ Value *PipeExpr::codegenPipe(BaseFunc *base,
       codegenPipe(base, state);
       state.inParallel = oldInParallel;
 
+#if SEQ_HAS_TAPIR
       builder.SetInsertPoint(state.block);
       builder.CreateReattach(cont, syncReg);
+#else
+      endTask(task, state.block, cont);
+#endif
 
       state.block = cont;
       return nullptr;
     }
-#endif /* SEQ_HAS_TAPIR */
 
     return codegenPipe(base, state);
   }
@@ -665,6 +986,10 @@ Value *PipeExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
   Module *module = block->getModule();
   Function *func = block->getParent();
 
+  std::vector<Expr *> stages(this->stages);
+  std::vector<bool> parallel(this->parallel);
+  applyPartitionedInputOptimization(stages, parallel);
+
   // unparallelize inter-seq alignment pipelines
   // multithreading will be handled by the alignment kernel
   bool unparallelize = false;
@@ -692,19 +1017,33 @@ Value *PipeExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
     }
   }
 
-  std::vector<Expr *> stages(this->stages);
-  std::vector<bool> parallel(this->parallel);
+#if !SEQ_HAS_TAPIR
+  // tasks are outlined into separate functions, which exceptions can't
+  // propagate out of
+  if (getTryCatch() &&
+      std::find(parallel.begin(), parallel.end(), true) != parallel.end() &&
+      !unparallelize) {
+    SrcInfo src = getSrcInfo();
+    compilationWarning("parallel pipeline in try block will run serially",
+                       src.file, src.line, src.col);
+    unparallelize = true;
+  }
+#endif
+
   applyRevCompOptimization(stages, parallel);
   applyCanonicalKmerOptimization(stages, parallel);
 
   std::queue<Expr *> queue;
   std::queue<bool> parallelQueue;
+  bool anyParallel = false;
 
   for (auto *stage : stages)
     queue.push(stage);
 
-  for (bool parallelize : parallel)
+  for (bool parallelize : parallel) {
     parallelQueue.push(parallelize && !unparallelize);
+    anyParallel = anyParallel || parallelQueue.back();
+  }
 
   entry = block;
   IRBuilder<> builder(entry);
@@ -713,6 +1052,13 @@ Value *PipeExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
   Function *syncStart =
       Intrinsic::getDeclaration(module, Intrinsic::syncregion_start);
   syncReg = builder.CreateCall(syncStart);
+#else
+  // task group: count of this pipeline's unfinished tasks
+  syncReg = nullptr;
+  if (anyParallel) {
+    syncReg = makeAlloca(seqIntLLVM(context), base->getPreamble());
+    builder.CreateStore(zeroLLVM(context), syncReg);
+  }
 #endif
 
   BasicBlock *start = BasicBlock::Create(context, "pipe_start", func);
@@ -759,15 +1105,68 @@ Value *PipeExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
   builder.SetInsertPoint(block);
 
   DrainState &drain = state.drain;
+
+  bool synced = false;
+  auto sync = [&]() {
+    builder.SetInsertPoint(block);
+#if SEQ_HAS_TAPIR
+    if (nestedParallel) {
+      builder.CreateCall(endTaskGroupFunc, {ompLoc, gtid});
+    } else {
+      BasicBlock *exit = BasicBlock::Create(context, "exit", func);
+      builder.CreateSync(exit, syncReg);
+      block = exit;
+    }
+#else
+    if (syncReg) {
+      auto *syncFunc = cast<Function>(module->getOrInsertFunction(
+          "seq_sched_sync", builder.getVoidTy(),
+          seqIntLLVM(context)->getPointerTo()));
+      builder.CreateCall(syncFunc, syncReg);
+    }
+#endif
+    synced = true;
+  };
+
+  // per-thread prefetch schedulers are drained once all tasks are done
+  if (drain.threads)
+    sync();
+  builder.SetInsertPoint(block);
+
   if (drain.states) {
     // drain step:
     types::GenType *genType = drain.type;
     Value *states = drain.states;
     Value *filled = drain.filled;
-    Value *N = builder.CreateLoad(filled);
     BasicBlock *loop = BasicBlock::Create(context, "drain", func);
 
     if (genType->fromPrefetch()) {
+      PHINode *thread = nullptr;
+      BasicBlock *threadLoop = nullptr;
+      BasicBlock *threadExit = nullptr;
+      if (drain.threads) {
+        // drain each thread's scheduler in turn
+        threadLoop = BasicBlock::Create(context, "drain_thread", func);
+        BasicBlock *threadBody = BasicBlock::Create(context, "body", func);
+        threadExit = BasicBlock::Create(context, "exit", func);
+        builder.CreateBr(threadLoop);
+
+        builder.SetInsertPoint(threadLoop);
+        thread = builder.CreatePHI(seqIntLLVM(context), 2);
+        thread->addIncoming(zeroLLVM(context), block);
+        Value *cond = builder.CreateICmpSLT(thread, drain.threads);
+        builder.CreateCondBr(cond, threadBody, threadExit);
+
+        builder.SetInsertPoint(threadBody);
+        states = builder.CreateGEP(
+            states, builder.CreateMul(thread, builder.getInt64(drain.width)));
+        filled = builder.CreateGEP(
+            filled, builder.CreateMul(
+                        thread, builder.getInt64(PREFETCH_COUNTER_STRIDE)));
+        block = threadBody;
+      }
+
+      Value *N = builder.CreateLoad(filled);
       BasicBlock *loop0 = loop;
       builder.CreateBr(loop);
 
@@ -820,19 +1219,28 @@ Value *PipeExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
       builder.CreateBr(loop0);
       control->addIncoming(next, finalize);
 
-      block = exit;
+      if (drain.threads) {
+        builder.SetInsertPoint(exit);
+        thread->addIncoming(builder.CreateAdd(thread, oneLLVM(context)), exit);
+        builder.CreateBr(threadLoop);
+        block = threadExit;
+      } else {
+        block = exit;
+      }
     } else if (genType->fromInterAlign()) {
       Func *flushFunc = Func::getBuiltin("_interaln_flush");
       Function *flush = flushFunc->getFunc(module);
 
+      Value *N = builder.CreateLoad(filled);
       Value *cond = builder.CreateICmpSGT(N, builder.getInt64(0));
       BasicBlock *exit = BasicBlock::Create(context, "exit", func);
       builder.CreateCondBr(cond, loop, exit);
 
       builder.SetInsertPoint(loop);
       N = builder.CreateCall(flush, {drain.pairs, drain.bufRef, drain.bufQer,
-                                     states, N, drain.params, drain.hist,
-                                     drain.pairsTemp, drain.statesTemp});
+                                     drain.bufLong, states, N, drain.params,
+                                     drain.hist, drain.pairsTemp,
+                                     drain.statesTemp});
       builder.CreateStore(N, filled);
       cond = builder.CreateICmpSGT(N, builder.getInt64(0));
       builder.CreateCondBr(cond, loop, exit); // keep flushing while not empty
@@ -843,17 +1251,9 @@ Value *PipeExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
     }
   }
 
-#if SEQ_HAS_TAPIR
-  builder.SetInsertPoint(block);
   // create sync
-  if (nestedParallel) {
-    builder.CreateCall(endTaskGroupFunc, {ompLoc, gtid});
-  } else {
-    BasicBlock *exit = BasicBlock::Create(context, "exit", func);
-    builder.CreateSync(exit, syncReg);
-    block = exit;
-  }
-#endif
+  if (!synced)
+    sync();
 
   // connect entry block:
   builder.SetInsertPoint(entry);
@@ -863,6 +1263,10 @@ Value *PipeExpr::codegen0(BaseFunc *base, BasicBlock *&block) {
 }
 
 types::Type *PipeExpr::getType0() const {
+  std::vector<Expr *> stages(this->stages);
+  std::vector<bool> parallel(this->parallel);
+  applyPartitionedInputOptimization(stages, parallel);
+
   types::Type *type = nullptr;
   for (auto *stage : stages) {
     if (!type) {
@@ -918,3 +1322,176 @@ types::RecordType *PipeExpr::getInterAlignSeqPairType() {
       {i32, i32, i32, i32, types::PtrType::get(i32), i32, i32},
       {"id", "len1", "len2", "score", "cigar", "n_cigar", "flags"}, "SeqPair");
 }
+
+#if !SEQ_HAS_TAPIR
+/*
+ * Collects the blocks of the task delimited by the given markers (header
+ * first). Returns false if they don't form a single-entry, single-exit
+ * region that can be outlined, e.g. if an exception can unwind out of it.
+ */
+static bool getTaskBlocks(CallInst *begin, CallInst *end,
+                          std::vector<BasicBlock *> &blocks) {
+  BasicBlock *header = begin->getParent();
+  BasicBlock *last = end->getParent();
+  SmallPtrSet<BasicBlock *, 32> seen;
+  std::vector<BasicBlock *> worklist = {header};
+  seen.insert(header);
+  blocks.clear();
+
+  while (!worklist.empty()) {
+    BasicBlock *block = worklist.back();
+    worklist.pop_back();
+    blocks.push_back(block);
+
+    auto *term = block->getTerminator();
+    if (block->isEHPad() || !term || isa<ReturnInst>(term) ||
+        isa<ResumeInst>(term))
+      return false;
+
+    if (block == last)
+      continue;
+
+    for (BasicBlock *succ : successors(block)) {
+      if (seen.insert(succ).second)
+        worklist.push_back(succ);
+    }
+  }
+
+  if (!seen.count(last))
+    return false;
+
+  for (BasicBlock *block : blocks) {
+    if (block == header)
+      continue;
+    for (BasicBlock *pred : predecessors(block)) {
+      if (!seen.count(pred))
+        return false;
+    }
+  }
+  return true;
+}
+#endif
+
+void PipeExpr::outlineParallelStages(Module *module) {
+#if !SEQ_HAS_TAPIR
+  Function *beginFunc = module->getFunction(TASK_BEGIN);
+  Function *endFunc = module->getFunction(TASK_END);
+  if (!beginFunc || !endFunc)
+    return;
+
+  LLVMContext &context = module->getContext();
+  auto taskID = [](CallInst *call) {
+    return cast<ConstantInt>(call->getArgOperand(call->getNumArgOperands() - 1))
+        ->getZExtValue();
+  };
+
+  std::map<uint64_t, CallInst *> ends;
+  for (User *user : endFunc->users()) {
+    auto *call = cast<CallInst>(user);
+    ends[taskID(call)] = call;
+  }
+
+  // outline inner tasks before the ones enclosing them
+  std::vector<std::pair<size_t, CallInst *>> begins;
+  for (User *user : beginFunc->users()) {
+    auto *call = cast<CallInst>(user);
+    std::vector<BasicBlock *> blocks;
+    getTaskBlocks(call, ends[taskID(call)], blocks);
+    begins.emplace_back(blocks.size(), call);
+  }
+  std::sort(begins.begin(), begins.end(),
+            [](const std::pair<size_t, CallInst *> &a,
+               const std::pair<size_t, CallInst *> &b) {
+              return a.first < b.first;
+            });
+
+  auto *spawnFunc = cast<Function>(module->getOrInsertFunction(
+      "seq_sched_spawn", Type::getVoidTy(context),
+      seqIntLLVM(context)->getPointerTo(), IntegerType::getInt8PtrTy(context),
+      IntegerType::getInt8PtrTy(context), seqIntLLVM(context)));
+  const DataLayout &layout = module->getDataLayout();
+
+  for (auto &pair : begins) {
+    CallInst *begin = pair.second;
+    CallInst *end = ends[taskID(begin)];
+    Value *group = begin->getArgOperand(0);
+
+    std::vector<BasicBlock *> blocks;
+    bool ok = getTaskBlocks(begin, end, blocks);
+    begin->eraseFromParent();
+    end->eraseFromParent();
+    if (!ok)
+      continue; // run serially
+
+    // the spawning loop can't wait for values the task computes
+    CodeExtractor extractor(blocks, /*DT=*/nullptr, /*AggregateArgs=*/true);
+    SetVector<Value *> inputs, outputs, sinks;
+    extractor.findInputsOutputs(inputs, outputs, sinks);
+    if (!extractor.isEligible() || !outputs.empty())
+      continue;
+
+    // stack slots only the task uses (e.g. argument buffers of tasks nested
+    // in this one) have to be private to each instance of it
+    SmallPtrSet<BasicBlock *, 32> region(blocks.begin(), blocks.end());
+    std::vector<AllocaInst *> moved;
+    for (Value *input : inputs) {
+      auto *alloca = dyn_cast<AllocaInst>(input);
+      if (!alloca)
+        continue;
+      bool local = true;
+      for (User *user : alloca->users()) {
+        auto *inst = dyn_cast<Instruction>(user);
+        local = local && inst && region.count(inst->getParent());
+      }
+      if (local) {
+        alloca->moveBefore(&*blocks.front()->getFirstInsertionPt());
+        moved.push_back(alloca);
+      }
+    }
+
+#if LLVM_VERSION_MAJOR >= 10
+    CodeExtractorAnalysisCache cache(*blocks.front()->getParent());
+    Function *task = extractor.extractCodeRegion(cache);
+#else
+    Function *task = extractor.extractCodeRegion();
+#endif
+    if (!task) {
+      // the region runs serially (possibly in a loop), so its stack slots
+      // go back to the entry block rather than growing the stack each time
+      BasicBlock &entry = blocks.front()->getParent()->getEntryBlock();
+      for (AllocaInst *alloca : moved)
+        alloca->moveBefore(&*entry.getFirstInsertionPt());
+      continue;
+    }
+    auto *call = cast<CallInst>(*task->user_begin());
+
+    Value *args = ConstantPointerNull::get(IntegerType::getInt8PtrTy(context));
+    uint64_t size = 0;
+    if (call->getNumArgOperands() > 0) {
+      args = call->getArgOperand(0);
+      size = layout.getTypeAllocSize(args->getType()->getPointerElementType());
+    } else {
+      // scheduler always passes an argument pointer
+      Function *wrapper = Function::Create(
+          FunctionType::get(Type::getVoidTy(context),
+                            {IntegerType::getInt8PtrTy(context)}, false),
+          GlobalValue::PrivateLinkage, task->getName() + ".spawn", module);
+      IRBuilder<> builder(BasicBlock::Create(context, "entry", wrapper));
+      builder.CreateCall(task);
+      builder.CreateRetVoid();
+      task = wrapper;
+    }
+
+    IRBuilder<> builder(call);
+    builder.CreateCall(
+        spawnFunc,
+        {group, builder.CreateBitCast(task, builder.getInt8PtrTy()),
+         builder.CreateBitCast(args, builder.getInt8PtrTy()),
+         ConstantInt::get(seqIntLLVM(context), size)});
+    call->eraseFromParent();
+  }
+
+  beginFunc->eraseFromParent();
+  endFunc->eraseFromParent();
+#endif
+}
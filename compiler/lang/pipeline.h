@@ -17,7 +17,9 @@ private:
 
 public:
   static const unsigned SCHED_WIDTH_PREFETCH = 16;
+  static const unsigned MAX_SCHED_WIDTH_PREFETCH = 1024;
   static const unsigned SCHED_WIDTH_INTERALIGN = 2048;
+  static const unsigned MAX_PARALLEL_GRAIN = SEQ_SCHED_MAX_GRAIN;
   explicit PipeExpr(std::vector<Expr *> stages,
                     std::vector<bool> parallel = {});
   void setParallel(unsigned which);
@@ -32,6 +34,10 @@ public:
   static llvm::Value *validateAndCodegenInterAlignParams(
       types::GenType::InterAlignParams &paramExprs, BaseFunc *base,
       llvm::BasicBlock *block);
+
+  /// Turns parallel stages into tasks for the runtime's scheduler, unless
+  /// Tapir handles them; must run on the module before it is optimized.
+  static void outlineParallelStages(llvm::Module *module);
 };
 
 } // namespace seq
@@ -60,7 +60,7 @@ static void invokeMain(Function *main, BasicBlock *&block) {
   LandingPadInst *caughtResult =
       builder.CreateLandingPad(TryCatch::getPadType(context), 1);
   caughtResult->setCleanup(true);
-  caughtResult->addClause(TryCatch::getTypeIdxVar(module, nullptr));
+  caughtResult->addClause(TryCatch::getTerminateIdxVar(module));
   Value *unwindException = builder.CreateExtractValue(caughtResult, 0);
   builder.CreateCall(term, unwindException);
   builder.CreateUnreachable();
@@ -325,6 +325,7 @@ static void applyGCTransformations(Module *module) {
 
 static void optimizeModule(Module *module) {
   const bool debug = config::config().debug;
+  PipeExpr::outlineParallelStages(module);
   if (debug)
     applyDebugTransformations(module);
   std::unique_ptr<legacy::PassManager> pm(new legacy::PassManager());
@@ -3,6 +3,59 @@
 using namespace seq;
 using namespace llvm;
 
+/*
+ * Radix sort keys: values of integer types, k-mers, types defining
+ * __radix__ (which must return a value whose key orders like the type
+ * itself) and tuples whose first element has one can be mapped to an
+ * unsigned integer that orders like the values, i.e. a < b implies
+ * key(a) <= key(b). The key is exact if key(a) < key(b) also implies a < b;
+ * tuples with more than one element only have exact keys for equal first
+ * elements, so ties must be broken by comparison.
+ */
+static unsigned radixBits(types::Type *type, bool *exact) {
+  *exact = true;
+  if (type->is(types::Int))
+    return 64;
+  if (type->is(types::Byte))
+    return 8;
+  if (auto *intN = dynamic_cast<types::IntNType *>(type))
+    return intN->getLen();
+  if (types::KMer *kmer = type->asKMer())
+    return 2 * kmer->getK();
+  if (types::Type *out = type->magicOut("__radix__", {}, true, true))
+    return radixBits(out, exact);
+  types::RecordType *rec = type->asRec();
+  if (rec && !rec->getTypes().empty() &&
+      !type->magicOut("__lt__", {type}, true, true)) {
+    unsigned bits = radixBits(rec->getTypes()[0], exact);
+    *exact = *exact && rec->getTypes().size() == 1;
+    return bits;
+  }
+  *exact = false;
+  return 0;
+}
+
+static Value *radixKey(types::Type *type, Value *val, BasicBlock *block) {
+  IRBuilder<> builder(block);
+  if (type->is(types::Int))
+    return builder.CreateXor(val, builder.getInt(APInt::getSignMask(64)));
+  if (auto *intN = dynamic_cast<types::IntNType *>(type)) {
+    if (!intN->isSigned())
+      return val;
+    return builder.CreateXor(
+        val, builder.getInt(APInt::getSignMask(intN->getLen())));
+  }
+  if (type->is(types::Byte) || type->asKMer())
+    return builder.CreateBitCast(
+        val, builder.getIntNTy(val->getType()->getIntegerBitWidth()));
+  if (types::Type *out = type->magicOut("__radix__", {}, true, true))
+    return radixKey(
+        out, type->callMagic("__radix__", {}, val, {}, block, nullptr), block);
+  types::RecordType *rec = type->asRec();
+  assert(rec);
+  return radixKey(rec->getTypes()[0], rec->memb(val, "1", block), block);
+}
+
 types::ArrayType::ArrayType(Type *baseType)
     : Type("array", BaseType::get()), baseType(baseType) {}
 
@@ -44,6 +97,41 @@ void types::ArrayType::initOps() {
        },
        true},
 
+      // bits in the radix sort key of the base type (0 if it has none)
+      {"__radix_bits__",
+       {},
+       Int,
+       [this](Value *self, std::vector<Value *> args, IRBuilder<> &b) {
+         bool exact;
+         const unsigned bits = radixBits(getBaseType(0), &exact);
+         return ConstantInt::get(seqIntLLVM(b.getContext()), bits);
+       },
+       true},
+
+      {"__radix_exact__",
+       {},
+       Bool,
+       [this](Value *self, std::vector<Value *> args, IRBuilder<> &b) {
+         bool exact;
+         const unsigned bits = radixBits(getBaseType(0), &exact);
+         return ConstantInt::get(Bool->getLLVMType(b.getContext()),
+                                 (bits && exact) ? 1 : 0);
+       },
+       true},
+
+      // radix sort key of an element; for base types without one, this is
+      // a dummy u8 zero so that generic code still type-checks
+      {"__radix_key__",
+       {getBaseType(0)},
+       radixKeyType(),
+       [this](Value *self, std::vector<Value *> args, IRBuilder<> &b) {
+         bool exact;
+         if (!radixBits(getBaseType(0), &exact))
+           return (Value *)b.getInt8(0);
+         return radixKey(getBaseType(0), args[0], b.GetInsertBlock());
+       },
+       true},
+
       {"__init__",
        {Int},
        this,
@@ -168,6 +256,12 @@ void types::ArrayType::initFields() {
 
 unsigned types::ArrayType::numBaseTypes() const { return 1; }
 
+types::Type *types::ArrayType::radixKeyType() {
+  bool exact;
+  const unsigned bits = radixBits(getBaseType(0), &exact);
+  return types::IntNType::get(bits ? bits : 8, false);
+}
+
 types::Type *types::ArrayType::getBaseType(unsigned idx) const {
   return baseType;
 }
@@ -25,6 +25,9 @@ public:
   size_t size(llvm::Module *module) const override;
   llvm::Value *make(llvm::Value *ptr, llvm::Value *len,
                     llvm::BasicBlock *block);
+  /// Unsigned integer type of the base type's radix sort key (see
+  /// __radix_key__)
+  Type *radixKeyType();
   static ArrayType *get(Type *baseType) noexcept;
   static ArrayType *get() noexcept;
 
@@ -95,6 +95,14 @@ void types::FuncType::initOps() {
          return codegenStr(self, "function", b.GetInsertBlock());
        },
        false},
+
+      {"__raw__",
+       {},
+       PtrType::get(Byte),
+       [](Value *self, std::vector<Value *> args, IRBuilder<> &b) {
+         return b.CreateBitCast(self, b.getInt8PtrTy());
+       },
+       false},
   };
 }
 
@@ -175,7 +183,7 @@ types::FuncType *types::FuncType::clone(Generic *ref) {
 
 types::GenType::GenType(Type *outType, GenTypeKind kind)
     : Type("generator", BaseType::get()), outType(outType), kind(kind),
-      alnParams() {}
+      alnParams(), prefetchWidth(0) {}
 
 bool types::GenType::isAtomic() const { return false; }
 
@@ -259,6 +267,18 @@ types::GenType::InterAlignParams types::GenType::getAlignParams() {
   return alnParams;
 }
 
+void types::GenType::setPrefetchWidth(unsigned width) {
+  if (!fromPrefetch())
+    throw exc::SeqException("prefetch functions must be marked '@prefetch'");
+  prefetchWidth = width;
+}
+
+unsigned types::GenType::getPrefetchWidth() {
+  if (!fromPrefetch())
+    throw exc::SeqException("prefetch functions must be marked '@prefetch'");
+  return prefetchWidth;
+}
+
 void types::GenType::initOps() {
   if (!vtable.magic.empty())
     return;
@@ -459,7 +479,9 @@ types::GenType *types::GenType::get(GenTypeKind kind) noexcept {
 }
 
 types::GenType *types::GenType::clone(Generic *ref) {
-  return get(outType->clone(ref), kind);
+  auto *x = get(outType->clone(ref), kind);
+  x->prefetchWidth = prefetchWidth;
+  return x;
 }
 
 types::PartialFuncType::PartialFuncType(types::Type *callee,
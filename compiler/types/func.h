@@ -55,6 +55,7 @@ private:
   Type *outType;
   GenTypeKind kind;
   InterAlignParams alnParams;
+  unsigned prefetchWidth; // scheduler width for prefetch; 0 for default
   explicit GenType(Type *outType, GenTypeKind = GenTypeKind::NORMAL);
 
 public:
@@ -75,6 +76,8 @@ public:
   bool fromInterAlign();
   void setAlignParams(InterAlignParams alnParams);
   InterAlignParams getAlignParams();
+  void setPrefetchWidth(unsigned width);
+  unsigned getPrefetchWidth();
 
   void initOps() override;
   bool is(Type *type) const override;
@@ -19,6 +19,10 @@ types::IntNType::IntNType(unsigned len, bool sign)
                             std::to_string(MAX_LEN));
 }
 
+unsigned types::IntNType::getLen() const { return len; }
+
+bool types::IntNType::isSigned() const { return sign; }
+
 types::FloatType::FloatType() : Type("float", NumberType::get(), false, true) {}
 
 types::BoolType::BoolType() : Type("bool", NumberType::get(), false, true) {}
@@ -44,6 +44,9 @@ public:
 
   llvm::Value *defaultValue(llvm::BasicBlock *block) override;
 
+  unsigned getLen() const;
+  bool isSigned() const;
+
   bool is(Type *type) const override;
   void initOps() override;
   llvm::Type *getLLVMType(llvm::LLVMContext &context) const override;
@@ -120,14 +120,20 @@ SEQ_FUNC std::string seq_get_symbol(void *addr) {
   return iter == symbols.end() ? "" : iter->second;
 }
 
-SEQ_FUNC void *seq_alloc_exc(int type, void *obj) {
 #ifdef BACKTRACE
-  // generate backtrace
+// Unwinding and symbol lookup are costly, and most exceptions are caught, so
+// backtraces are only recorded for exceptions known to be uncaught: those the
+// search phase matches to the handler around main, or those it finds no
+// handler for at all. Either way no frames have been unwound yet, so the
+// frames from the raise site up are still there, above seq_throw's.
+__attribute__((noinline)) static void
+seq_capture_backtrace(OurException *exc) {
   unw_cursor_t cursor;
   unw_context_t context;
   unw_getcontext(&context);
   unw_init_local(&cursor, &context);
   std::vector<BTItem> btv;
+  bool raised = false;
 
   while (btv.size() < BACKTRACE_LIMIT && unw_step(&cursor) > 0) {
     unw_word_t pc, offset = -1;
@@ -136,6 +142,12 @@ SEQ_FUNC void *seq_alloc_exc(int type, void *obj) {
     if (pc == 0 || unw_get_proc_info(&cursor, &info) != 0)
       break;
 
+    // skip the unwinder's frames
+    if (!raised) {
+      raised = (info.start_ip == (unw_word_t)&seq_throw);
+      continue;
+    }
+
     std::string sym;
     if (!symbols.empty()) {
       sym = seq_get_symbol((void *)info.start_ip);
@@ -160,22 +172,20 @@ SEQ_FUNC void *seq_alloc_exc(int type, void *obj) {
     btv.push_back(item);
   }
 
-  BTItem *bt = nullptr;
   if (!btv.empty()) {
-    bt = (BTItem *)seq_alloc(btv.size() * sizeof(*bt));
-    memcpy(bt, &btv[0], btv.size() * sizeof(*bt));
+    exc->bt = (BTItem *)seq_alloc(btv.size() * sizeof(*exc->bt));
+    memcpy(exc->bt, &btv[0], btv.size() * sizeof(*exc->bt));
+    exc->bt_count = btv.size();
   }
+}
 #endif
 
+SEQ_FUNC void *seq_alloc_exc(int type, void *obj) {
   const size_t size = sizeof(OurException);
   auto *e = (OurException *)memset(seq_alloc(size), 0, size);
   assert(e);
   e->type.type = type;
   e->obj = obj;
-#ifdef BACKTRACE
-  e->bt = bt;
-  e->bt_count = btv.size();
-#endif
   e->unwindException.exception_class = ourBaseExceptionClass;
   e->unwindException.exception_cleanup = seq_delete_unwind_exc;
   return &(e->unwindException);
@@ -253,6 +263,12 @@ SEQ_FUNC void seq_terminate(void *exc) {
 SEQ_FUNC void seq_throw(void *exc) {
   _Unwind_Reason_Code code = _Unwind_RaiseException((_Unwind_Exception *)exc);
   (void)code;
+#ifdef BACKTRACE
+  auto *e = (OurException *)((char *)exc + ourBaseFromUnwindOffset);
+  if (e->unwindException.exception_class == ourBaseExceptionClass &&
+      !e->bt_count)
+    seq_capture_backtrace(e);
+#endif
   seq_terminate(exc);
 }
 
@@ -388,9 +404,9 @@ static uintptr_t readEncodedPointer(const uint8_t **data, uint8_t encoding) {
   return result;
 }
 
-static bool handleActionValue(int64_t *resultAction, uint8_t TTypeEncoding,
-                              const uint8_t *ClassInfo, uintptr_t actionEntry,
-                              uint64_t exceptionClass,
+static bool handleActionValue(int64_t *resultAction, bool *terminate,
+                              uint8_t TTypeEncoding, const uint8_t *ClassInfo,
+                              uintptr_t actionEntry, uint64_t exceptionClass,
                               _Unwind_Exception *exceptionObject) {
   bool ret = false;
 
@@ -423,9 +439,12 @@ static bool handleActionValue(int64_t *resultAction, uint8_t TTypeEncoding,
       const uint8_t *EntryP = ClassInfo - typeOffset * EncSize;
       uintptr_t P = readEncodedPointer(&EntryP, TTypeEncoding);
       auto *ThisClassInfo = reinterpret_cast<OurExceptionType_t *>(P);
-      // type=0 means catch-all
-      if (ThisClassInfo->type == 0 || ThisClassInfo->type == type) {
+      // type=0 means catch-all, as does the handler around main
+      if (ThisClassInfo->type == 0 ||
+          ThisClassInfo->type == SEQ_EXC_TYPE_TERMINATE ||
+          ThisClassInfo->type == type) {
         *resultAction = i + 1;
+        *terminate = (ThisClassInfo->type == SEQ_EXC_TYPE_TERMINATE);
         ret = true;
         break;
       }
@@ -517,11 +536,12 @@ static _Unwind_Reason_Code handleLsda(int version, const uint8_t *lsda,
 
     if ((start <= pcOffset) && (pcOffset < (start + length))) {
       int64_t actionValue = 0;
+      bool terminate = false;
 
       if (actionEntry) {
-        exceptionMatched =
-            handleActionValue(&actionValue, ttypeEncoding, ClassInfo,
-                              actionEntry, exceptionClass, exceptionObject);
+        exceptionMatched = handleActionValue(
+            &actionValue, &terminate, ttypeEncoding, ClassInfo, actionEntry,
+            exceptionClass, exceptionObject);
       }
 
       if (!(actions & _UA_SEARCH_PHASE)) {
@@ -548,6 +568,11 @@ static _Unwind_Reason_Code handleLsda(int version, const uint8_t *lsda,
         _Unwind_SetIP(context, funcStart + landingPad);
         ret = _URC_INSTALL_CONTEXT;
       } else if (exceptionMatched) {
+#ifdef BACKTRACE
+        if (terminate)
+          seq_capture_backtrace((OurException *)((char *)exceptionObject +
+                                                 ourBaseFromUnwindOffset));
+#endif
         ret = _URC_HANDLER_FOUND;
       }
 
@@ -0,0 +1,604 @@
+#include "lib.h"
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
+
+/*
+ * Threaded input streams
+ *
+ * A stream produces a sequence of (decompressed) chunks in file order on
+ * background threads; LineStream splits those chunks into lines for the
+ * consumer. Lines are returned as pointers into the stream's own buffers
+ * and stay valid until the next call to seq_stream_getline.
+ */
+
+namespace {
+class ChunkSource {
+public:
+  virtual ~ChunkSource() = default;
+  // Blocks until the next chunk is available. Returns false at end of input
+  // or on error (in which case failed() is true). The previous chunk may be
+  // reused once this is called again.
+  virtual bool next(const char **data, size_t *len) = 0;
+  virtual bool failed() const = 0;
+};
+
+class LineStream {
+  ChunkSource *src;
+  const char *chunk;
+  size_t len;
+  size_t pos;
+  vector<char> carry;
+
+public:
+  explicit LineStream(ChunkSource *src)
+      : src(src), chunk(nullptr), len(0), pos(0), carry() {}
+
+  ~LineStream() { delete src; }
+
+  seq_int_t getline(char **line) {
+    carry.clear();
+    while (true) {
+      if (pos == len) {
+        if (!src->next(&chunk, &len)) {
+          if (src->failed())
+            return -2;
+          if (carry.empty())
+            return -1;
+          *line = carry.data();
+          return (seq_int_t)carry.size();
+        }
+        pos = 0;
+        continue;
+      }
+
+      const char *start = chunk + pos;
+      auto *nl = (const char *)memchr(start, '\n', len - pos);
+      if (!nl) {
+        carry.insert(carry.end(), start, chunk + len);
+        pos = len;
+        continue;
+      }
+
+      size_t n = (size_t)(nl - start);
+      pos += n + 1;
+      if (carry.empty()) {
+        *line = const_cast<char *>(start);
+        return (seq_int_t)n;
+      }
+      carry.insert(carry.end(), start, nl);
+      *line = carry.data();
+      return (seq_int_t)carry.size();
+    }
+  }
+};
+
+/*
+ * BGZF
+ *
+ * Blocks are read sequentially by one I/O thread into a ring of slots,
+ * inflated by a pool of workers, and handed to the consumer in order.
+ */
+
+const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+const size_t BGZF_HEADER_SIZE = 12;
+
+struct BGZFBlock {
+  vector<unsigned char> cdata;
+  vector<char> udata;
+  size_t ulen;
+};
+
+enum ReadStatus { BLOCK_OK, BLOCK_END, BLOCK_BAD };
+
+// Reads a block header, storing the size of the rest of the block in `rest`.
+ReadStatus readBGZFHeader(FILE *fp, size_t *rest) {
+  unsigned char header[BGZF_HEADER_SIZE];
+  size_t n = fread(header, 1, BGZF_HEADER_SIZE, fp);
+  if (n == 0 && feof(fp))
+    return BLOCK_END;
+  if (n != BGZF_HEADER_SIZE || header[0] != 31 || header[1] != 139 ||
+      header[2] != 8 || !(header[3] & 4))
+    return BLOCK_BAD;
+
+  size_t xlen = (size_t)header[10] | ((size_t)header[11] << 8);
+  vector<unsigned char> extra(xlen);
+  if (fread(extra.data(), 1, xlen, fp) != xlen)
+    return BLOCK_BAD;
+
+  size_t bsize = 0;
+  for (size_t i = 0; i + 4 <= xlen;) {
+    size_t slen = (size_t)extra[i + 2] | ((size_t)extra[i + 3] << 8);
+    if (extra[i] == 'B' && extra[i + 1] == 'C' && slen == 2 && i + 6 <= xlen)
+      bsize = ((size_t)extra[i + 4] | ((size_t)extra[i + 5] << 8)) + 1;
+    i += 4 + slen;
+  }
+
+  if (bsize < BGZF_HEADER_SIZE + xlen + 8)
+    return BLOCK_BAD;
+
+  *rest = bsize - BGZF_HEADER_SIZE - xlen;
+  return BLOCK_OK;
+}
+
+ReadStatus readBGZFBlock(FILE *fp, BGZFBlock &block) {
+  size_t rest = 0;
+  ReadStatus status = readBGZFHeader(fp, &rest);
+  if (status != BLOCK_OK)
+    return status;
+  block.cdata.resize(rest);
+  if (fread(block.cdata.data(), 1, rest, fp) != rest)
+    return BLOCK_BAD;
+  return BLOCK_OK;
+}
+
+bool inflateBGZFBlock(BGZFBlock &block) {
+  const size_t clen = block.cdata.size() - 8;
+  const unsigned char *footer = block.cdata.data() + clen;
+  size_t isize = (size_t)footer[4] | ((size_t)footer[5] << 8) |
+                 ((size_t)footer[6] << 16) | ((size_t)footer[7] << 24);
+  if (isize > BGZF_MAX_BLOCK_SIZE)
+    return false;
+
+  block.udata.resize(BGZF_MAX_BLOCK_SIZE);
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, -15) != Z_OK)
+    return false;
+  zs.next_in = block.cdata.data();
+  zs.avail_in = (uInt)clen;
+  zs.next_out = (Bytef *)block.udata.data();
+  zs.avail_out = (uInt)block.udata.size();
+  int ret = inflate(&zs, Z_FINISH);
+  inflateEnd(&zs);
+  if (ret != Z_STREAM_END || zs.total_out != isize)
+    return false;
+
+  block.ulen = isize;
+  return true;
+}
+
+class BGZFSource : public ChunkSource {
+  enum State { EMPTY, READ, DONE, ERROR };
+
+  struct Slot : BGZFBlock {
+    State state;
+  };
+
+  FILE *fp;
+  vector<Slot> ring;
+  deque<size_t> work;
+  size_t produced; // number of blocks read by the I/O thread
+  size_t consumed; // number of blocks handed to the consumer
+  bool eof;
+  bool error;
+  bool stop;
+  mutex m;
+  condition_variable cv;
+  vector<thread> threads;
+
+  void ioLoop() {
+    while (true) {
+      unique_lock<mutex> lock(m);
+      Slot &slot = ring[produced % ring.size()];
+      cv.wait(lock, [&] { return stop || slot.state == EMPTY; });
+      if (stop)
+        return;
+      lock.unlock();
+
+      ReadStatus status = readBGZFBlock(fp, slot);
+
+      lock.lock();
+      if (status != BLOCK_OK) {
+        error = (status == BLOCK_BAD);
+        eof = true;
+        cv.notify_all();
+        return;
+      }
+      slot.state = READ;
+      work.push_back(produced++);
+      cv.notify_all();
+    }
+  }
+
+  void workerLoop() {
+    while (true) {
+      unique_lock<mutex> lock(m);
+      cv.wait(lock, [&] { return stop || !work.empty() || eof; });
+      if (stop || (work.empty() && eof))
+        return;
+      size_t idx = work.front();
+      work.pop_front();
+      Slot &slot = ring[idx % ring.size()];
+      lock.unlock();
+
+      bool ok = inflateBGZFBlock(slot);
+
+      lock.lock();
+      slot.state = ok ? DONE : ERROR;
+      cv.notify_all();
+    }
+  }
+
+public:
+  BGZFSource(FILE *fp, int nthreads)
+      : fp(fp), ring(), work(), produced(0), consumed(0), eof(false),
+        error(false), stop(false), m(), cv(), threads() {
+    if (nthreads <= 0)
+      nthreads = (int)thread::hardware_concurrency();
+    if (nthreads <= 0)
+      nthreads = 1;
+    ring.resize(4 * (size_t)nthreads);
+    for (auto &slot : ring) {
+      slot.state = EMPTY;
+      slot.ulen = 0;
+    }
+    threads.emplace_back(&BGZFSource::ioLoop, this);
+    for (int i = 0; i < nthreads; i++)
+      threads.emplace_back(&BGZFSource::workerLoop, this);
+  }
+
+  ~BGZFSource() override {
+    {
+      lock_guard<mutex> lock(m);
+      stop = true;
+    }
+    cv.notify_all();
+    for (auto &t : threads)
+      t.join();
+    fclose(fp);
+  }
+
+  bool next(const char **data, size_t *len) override {
+    unique_lock<mutex> lock(m);
+    if (consumed > 0) {
+      ring[(consumed - 1) % ring.size()].state = EMPTY;
+      cv.notify_all();
+    }
+
+    while (true) {
+      Slot &slot = ring[consumed % ring.size()];
+      cv.wait(lock, [&] {
+        return slot.state == DONE || slot.state == ERROR ||
+               (eof && consumed == produced);
+      });
+      if (slot.state == ERROR || (consumed == produced && error)) {
+        error = true;
+        return false;
+      }
+      if (slot.state != DONE)
+        return false;
+
+      ++consumed;
+      if (slot.ulen == 0) { // e.g. the EOF marker block
+        slot.state = EMPTY;
+        cv.notify_all();
+        continue;
+      }
+      *data = slot.udata.data();
+      *len = slot.ulen;
+      return true;
+    }
+  }
+
+  bool failed() const override { return error; }
+};
+
+/*
+ * BGZF ranges
+ *
+ * Input partitions are delimited by BGZF virtual offsets (the compressed
+ * offset of a block shifted left by 16, plus an offset into its inflated
+ * data) and are inflated on the consumer's own thread, since partitions
+ * are themselves read in parallel.
+ */
+
+class BGZFRangeSource : public ChunkSource {
+  FILE *fp;
+  BGZFBlock block;
+  off_t nextBlock; // compressed offset of the next block
+  size_t skip;     // bytes to skip in the first block
+  off_t endBlock;  // compressed offset of the last block in the range
+  size_t endLimit; // bytes of the last block in the range
+  bool done;
+  bool error;
+
+public:
+  BGZFRangeSource(FILE *fp, seq_int_t start, seq_int_t end)
+      : fp(fp), block(), nextBlock((off_t)(start >> 16)),
+        skip((size_t)(start & 0xffff)), endBlock((off_t)(end >> 16)),
+        endLimit((size_t)(end & 0xffff)), done(false), error(false) {
+    block.ulen = 0;
+    if (fseeko(fp, nextBlock, SEEK_SET) != 0)
+      error = done = true;
+  }
+
+  ~BGZFRangeSource() override { fclose(fp); }
+
+  bool next(const char **data, size_t *len) override {
+    while (!done) {
+      if (nextBlock > endBlock || (nextBlock == endBlock && endLimit == 0))
+        break;
+
+      off_t at = nextBlock;
+      ReadStatus status = readBGZFBlock(fp, block);
+      if (status == BLOCK_END)
+        break;
+      if (status == BLOCK_BAD || !inflateBGZFBlock(block)) {
+        error = true;
+        break;
+      }
+      nextBlock = ftello(fp);
+
+      size_t lo = skip < block.ulen ? skip : block.ulen;
+      size_t hi = block.ulen;
+      skip = 0;
+      if (at == endBlock) {
+        hi = endLimit < hi ? endLimit : hi;
+        done = true;
+      }
+      if (hi > lo) {
+        *data = block.udata.data() + lo;
+        *len = hi - lo;
+        return true;
+      }
+    }
+    done = true;
+    return false;
+  }
+
+  bool failed() const override { return error; }
+};
+
+// Finds the virtual offset of the first record starting in or after the
+// given block, or -1 if there is none.
+seq_int_t bgzfSync(FILE *fp, const vector<off_t> &blocks, size_t first,
+                   char fmt) {
+  // A leading sentinel byte makes seq_fastx_sync skip the partial line that
+  // the block starts with, except at the start of the file.
+  vector<char> buf(1, first == 0 ? '\n' : '\0');
+  vector<size_t> starts;
+  BGZFBlock block;
+  if (fseeko(fp, blocks[first], SEEK_SET) != 0)
+    return -1;
+
+  for (size_t i = first; i < blocks.size(); i++) {
+    if (readBGZFBlock(fp, block) != BLOCK_OK || !inflateBGZFBlock(block))
+      return -1;
+    starts.push_back(buf.size());
+    buf.insert(buf.end(), block.udata.data(), block.udata.data() + block.ulen);
+
+    seq_int_t n = (seq_int_t)buf.size();
+    seq_int_t pos = seq_fastx_sync(buf.data(), n, 1, fmt);
+    if (pos == n)
+      continue;
+
+    size_t j = starts.size() - 1;
+    while (starts[j] > (size_t)pos)
+      --j;
+    return ((seq_int_t)blocks[first + j] << 16) | (pos - (seq_int_t)starts[j]);
+  }
+  return -1;
+}
+/*
+ * Read-ahead
+ *
+ * One I/O thread fills a small ring of fixed-size buffers from a stdio or
+ * zlib handle so that reads (and gzip inflation) overlap with the consumer.
+ */
+
+class PrefetchSource : public ChunkSource {
+  struct Buffer {
+    vector<char> data;
+    size_t len;
+    bool full;
+  };
+
+  FILE *fp;
+  gzFile gz;
+  vector<Buffer> ring;
+  size_t produced;
+  size_t consumed;
+  bool eof;
+  bool error;
+  bool stop;
+  mutex m;
+  condition_variable cv;
+  thread io;
+
+  // Returns the number of bytes read, 0 at end of input or -1 on error.
+  long readChunk(char *buf, size_t n) {
+    if (gz) {
+      int k = gzread(gz, buf, (unsigned)n);
+      return k < 0 ? -1 : (long)k;
+    }
+    size_t k = fread(buf, 1, n, fp);
+    return (k == 0 && ferror(fp)) ? -1 : (long)k;
+  }
+
+  void ioLoop() {
+    while (true) {
+      unique_lock<mutex> lock(m);
+      Buffer &buf = ring[produced % ring.size()];
+      cv.wait(lock, [&] { return stop || !buf.full; });
+      if (stop)
+        return;
+      lock.unlock();
+
+      long n = readChunk(buf.data.data(), buf.data.size());
+
+      lock.lock();
+      if (n <= 0) {
+        error = (n < 0);
+        eof = true;
+        cv.notify_all();
+        return;
+      }
+      buf.len = (size_t)n;
+      buf.full = true;
+      ++produced;
+      cv.notify_all();
+    }
+  }
+
+public:
+  PrefetchSource(FILE *fp, gzFile gz, size_t chunkSize, size_t nbuffers)
+      : fp(fp), gz(gz), ring(), produced(0), consumed(0), eof(false),
+        error(false), stop(false), m(), cv(), io() {
+    ring.resize(nbuffers < 2 ? 2 : nbuffers);
+    for (auto &buf : ring) {
+      buf.data.resize(chunkSize);
+      buf.len = 0;
+      buf.full = false;
+    }
+    io = thread(&PrefetchSource::ioLoop, this);
+  }
+
+  ~PrefetchSource() override {
+    {
+      lock_guard<mutex> lock(m);
+      stop = true;
+    }
+    cv.notify_all();
+    io.join();
+    if (gz)
+      gzclose(gz);
+    if (fp)
+      fclose(fp);
+  }
+
+  bool next(const char **data, size_t *len) override {
+    unique_lock<mutex> lock(m);
+    if (consumed > 0) {
+      ring[(consumed - 1) % ring.size()].full = false;
+      cv.notify_all();
+    }
+
+    Buffer &buf = ring[consumed % ring.size()];
+    cv.wait(lock, [&] { return buf.full || (eof && consumed == produced); });
+    if (!buf.full)
+      return false;
+
+    ++consumed;
+    *data = buf.data.data();
+    *len = buf.len;
+    return true;
+  }
+
+  bool failed() const override { return error; }
+};
+} // namespace
+
+// Whether path is a regular file, i.e. can be read more than once and
+// split by offset (unlike stdin, pipes and FIFOs).
+SEQ_FUNC bool seq_is_regular_file(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Only regular files are sniffed: reading the header of a pipe would
+// consume it.
+SEQ_FUNC bool seq_is_bgzf(const char *path) {
+  if (!seq_is_regular_file(path))
+    return false;
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return false;
+  unsigned char h[18];
+  size_t n = fread(h, 1, sizeof(h), fp);
+  fclose(fp);
+  return n == sizeof(h) && h[0] == 31 && h[1] == 139 && h[2] == 8 &&
+         (h[3] & 4) && h[12] == 'B' && h[13] == 'C' && h[14] == 2 &&
+         h[15] == 0;
+}
+
+SEQ_FUNC void *seq_bgzf_open(const char *path, seq_int_t nthreads) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return nullptr;
+  return new LineStream(new BGZFSource(fp, (int)nthreads));
+}
+
+SEQ_FUNC void *seq_bgzf_open_range(const char *path, seq_int_t start,
+                                   seq_int_t end) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return nullptr;
+  return new LineStream(new BGZFRangeSource(fp, start, end));
+}
+
+// Splits the BGZF-compressed FASTQ (fmt '@') or FASTA (fmt '>') file at path
+// into at most n ranges of about the same compressed size that each start on
+// a record boundary. The n + 1 or fewer range bounds (as virtual offsets) are
+// written to `bounds`; returns their number, or -1 on error.
+SEQ_FUNC seq_int_t seq_bgzf_split(const char *path, seq_int_t n, char fmt,
+                                  seq_int_t *bounds) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return -1;
+
+  vector<off_t> blocks;
+  while (true) {
+    off_t at = ftello(fp);
+    size_t rest = 0;
+    ReadStatus status = readBGZFHeader(fp, &rest);
+    if (status == BLOCK_END)
+      break;
+    if (status == BLOCK_BAD || fseeko(fp, (off_t)rest, SEEK_CUR) != 0) {
+      fclose(fp);
+      return -1;
+    }
+    blocks.push_back(at);
+  }
+  off_t size = ftello(fp);
+
+  seq_int_t m = 0;
+  bounds[m++] = 0;
+  for (seq_int_t i = 1; i < n && !blocks.empty(); i++) {
+    size_t b = (size_t)(i * (seq_int_t)blocks.size() / n);
+    if (b == 0 || (off_t)(bounds[m - 1] >> 16) > blocks[b])
+      continue;
+    seq_int_t v = bgzfSync(fp, blocks, b, fmt);
+    if (v < 0)
+      break;
+    if (v > bounds[m - 1])
+      bounds[m++] = v;
+  }
+  bounds[m++] = (seq_int_t)size << 16;
+  fclose(fp);
+  return m;
+}
+
+SEQ_FUNC void *seq_prefetch_open(const char *path, bool gzip,
+                                 seq_int_t chunk_size, seq_int_t nbuffers) {
+  if (chunk_size <= 0 || chunk_size > INT_MAX)
+    return nullptr;
+  FILE *fp = nullptr;
+  gzFile gz = nullptr;
+  if (gzip)
+    gz = gzopen(path, "rb");
+  else
+    fp = fopen(path, "rb");
+  if (!fp && !gz)
+    return nullptr;
+  return new LineStream(
+      new PrefetchSource(fp, gz, (size_t)chunk_size, (size_t)nbuffers));
+}
+
+// Returns the length of the next line (without its newline), -1 at end of
+// input or -2 on error.
+SEQ_FUNC seq_int_t seq_stream_getline(void *stream, char **line) {
+  return ((LineStream *)stream)->getline(line);
+}
+
+SEQ_FUNC void seq_stream_close(void *stream) { delete (LineStream *)stream; }
@@ -1,21 +1,34 @@
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
 #include <chrono>
 #include <climits>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <pthread.h>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 #include <unordered_map>
 #include <unwind.h>
 #include <vector>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #if THREADED
 #include <omp.h>
 #define GC_THREADS
@@ -33,6 +46,10 @@ using namespace std;
 
 void seq_exc_init();
 
+#if THREADED
+static const size_t GC_INITIAL_HEAP_PER_THREAD = 16 << 20;
+#endif
+
 SEQ_FUNC void seq_init() {
   GC_INIT();
   GC_set_warn_proc(GC_ignore_warn_proc);
@@ -40,6 +57,12 @@ SEQ_FUNC void seq_init() {
 #if THREADED
   GC_allow_register_threads();
 
+  // collections stop every thread, so start multithreaded programs with a
+  // bigger heap unless GC_INITIAL_HEAP_SIZE is given
+  const int threads = omp_get_max_threads();
+  if (threads > 1 && !getenv("GC_INITIAL_HEAP_SIZE"))
+    GC_expand_hp((size_t)threads * GC_INITIAL_HEAP_PER_THREAD);
+
 #pragma omp parallel
   {
     GC_stack_base sb;
@@ -95,10 +118,7 @@ SEQ_FUNC void *seq_calloc(size_t m, size_t n) {
 #if USE_STANDARD_MALLOC
   return calloc(m, n);
 #else
-  size_t s = m * n;
-  void *p = GC_MALLOC(s);
-  memset(p, 0, s);
-  return p;
+  return GC_MALLOC(m * n); // already cleared
 #endif
 }
 
@@ -160,6 +180,109 @@ SEQ_FUNC void seq_gc_exclude_static_roots(void *start, void *end) {
 #endif
 }
 
+SEQ_FUNC void seq_gc_collect() {
+#if !USE_STANDARD_MALLOC
+  GC_gcollect();
+  GC_invoke_finalizers();
+#endif
+}
+
+/*
+ * Arenas
+ *
+ * An arena hands out memory by bumping a pointer through large chunks and
+ * frees all of it at once. Chunks come from malloc, so the GC neither scans
+ * nor collects them: arena memory is for scratch data that doesn't point to
+ * GC-allocated objects and isn't used once the arena is reset or freed.
+ * Each thread also has a scratch arena for the runtime's own temporaries
+ * (see SeqScratchScope in lib.h), reset when the outermost scope using it
+ * ends.
+ */
+
+namespace {
+const size_t ARENA_ALIGN = 16;
+const size_t ARENA_MIN_CHUNK = 1 << 16;
+// chunks grow up to this size, and bigger ones aren't kept across resets
+const size_t ARENA_MAX_CHUNK = 1 << 24;
+
+struct ArenaChunk {
+  ArenaChunk *prev;
+  size_t size;
+  // followed by the chunk's memory
+};
+
+struct Arena {
+  ArenaChunk *chunk;
+  char *pos;
+  char *end;
+
+  Arena() : chunk(nullptr), pos(nullptr), end(nullptr) {}
+  ~Arena() { release(nullptr); }
+
+  void release(ArenaChunk *keep) {
+    while (chunk) {
+      ArenaChunk *prev = chunk->prev;
+      if (chunk != keep)
+        free(chunk);
+      chunk = prev;
+    }
+    chunk = keep;
+    if (chunk) {
+      chunk->prev = nullptr;
+      pos = (char *)(chunk + 1);
+      end = pos + chunk->size;
+    } else {
+      pos = end = nullptr;
+    }
+  }
+};
+
+thread_local Arena scratchArena;
+thread_local int scratchDepth = 0;
+} // namespace
+
+SEQ_FUNC void *seq_arena_new() { return new Arena(); }
+
+SEQ_FUNC void *seq_arena_alloc(void *arena, size_t n) {
+  auto *a = (Arena *)arena;
+  n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if ((size_t)(a->end - a->pos) < n) {
+    size_t size = a->chunk ? min(2 * a->chunk->size, ARENA_MAX_CHUNK)
+                           : ARENA_MIN_CHUNK;
+    size = max(size, n);
+    auto *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + size);
+    if (!chunk)
+      throw bad_alloc();
+    chunk->prev = a->chunk;
+    chunk->size = size;
+    a->chunk = chunk;
+    a->pos = (char *)(chunk + 1);
+    a->end = a->pos + size;
+  }
+  void *p = a->pos;
+  a->pos += n;
+  return p;
+}
+
+SEQ_FUNC void seq_arena_reset(void *arena) {
+  // the newest chunk is normally the biggest, so keep it for reuse
+  auto *a = (Arena *)arena;
+  a->release(a->chunk && a->chunk->size <= ARENA_MAX_CHUNK ? a->chunk
+                                                           : nullptr);
+}
+
+SEQ_FUNC void seq_arena_free(void *arena) { delete (Arena *)arena; }
+
+SEQ_FUNC void *seq_arena_scratch_enter() {
+  ++scratchDepth;
+  return &scratchArena;
+}
+
+SEQ_FUNC void seq_arena_scratch_exit() {
+  if (--scratchDepth == 0)
+    seq_arena_reset(&scratchArena);
+}
+
 /*
  * String conversion
  */
@@ -214,6 +337,334 @@ SEQ_FUNC void *seq_stdout() { return stdout; }
 
 SEQ_FUNC void *seq_stderr() { return stderr; }
 
+/*
+ * Memory-mapped files
+ *
+ * Maps the file at `path` read-only and stores its size in `len`. Returns
+ * null with `len` set to -1 on error (errno is preserved for the caller),
+ * or null with `len` set to 0 for an empty file, which cannot be mapped.
+ */
+
+SEQ_FUNC void *seq_mmap(const char *path, seq_int_t *len) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    *len = -1;
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    *len = -1;
+    return nullptr;
+  }
+
+  *len = (seq_int_t)st.st_size;
+  if (st.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int err = errno;
+  close(fd); // mapping stays valid after the descriptor is closed
+  if (p == MAP_FAILED) {
+    errno = err;
+    *len = -1;
+    return nullptr;
+  }
+
+  madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+  return p;
+}
+
+SEQ_FUNC void seq_munmap(void *p, seq_int_t len) {
+  if (p && len > 0)
+    munmap(p, (size_t)len);
+}
+
+// for mappings that are searched rather than scanned, e.g. FM-indices
+SEQ_FUNC void seq_madvise_random(void *p, seq_int_t len) {
+  if (p && len > 0)
+    madvise(p, (size_t)len, MADV_RANDOM);
+}
+
+/*
+ * Sequence parsing
+ *
+ * seq_iupac_nt_table is consistent with _is_iupac_nt in bio/builtin.seq
+ */
+
+static const bool seq_iupac_nt_table[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 1,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 0, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0, 0, 0, 1, 1, 1, 1, 1, 1,
+    0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static seq_int_t validate_nt_scalar(const char *p, seq_int_t i, seq_int_t n) {
+  for (; i < n; i++) {
+    if (!seq_iupac_nt_table[(unsigned char)p[i]])
+      return i;
+  }
+  return -1;
+}
+
+static seq_int_t validate_qual_scalar(const char *p, seq_int_t i,
+                                      seq_int_t n) {
+  for (; i < n; i++) {
+    if (p[i] < 0x21 || p[i] > 0x7e)
+      return i;
+  }
+  return -1;
+}
+
+// 2-bit codes (A=0, C=1, G=2, T=3, either case) or 4 for any other byte,
+// consistent with seq._nt4_table in bio/seq.seq. The code is computed from
+// the bits of the letter rather than looked up, so that the vector paths
+// can do the same.
+static inline char encode_nt4(char b) {
+  char v = b | 0x20;
+  bool ok = v == 'a' || v == 'c' || v == 'g' || v == 't';
+  return ok ? ((v >> 1) ^ (v >> 2)) & 3 : 4;
+}
+
+static void encode_nt4_scalar(const char *p, seq_int_t i, seq_int_t n,
+                              char *out) {
+  for (; i < n; i++)
+    out[i] = encode_nt4(p[i]);
+}
+
+#if defined(__x86_64__)
+// Vector paths only accept ACGTN (either case) outright; blocks containing
+// any other IUPAC code are rechecked with the scalar table, so results are
+// identical to the scalar path.
+static seq_int_t validate_nt_sse2(const char *p, seq_int_t n) {
+  const __m128i lower = _mm_set1_epi8(0x20);
+  const __m128i a = _mm_set1_epi8('a');
+  const __m128i c = _mm_set1_epi8('c');
+  const __m128i g = _mm_set1_epi8('g');
+  const __m128i t = _mm_set1_epi8('t');
+  const __m128i N = _mm_set1_epi8('n');
+  seq_int_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v =
+        _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)), lower);
+    __m128i ok = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, c)),
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, g), _mm_cmpeq_epi8(v, t)),
+                     _mm_cmpeq_epi8(v, N)));
+    if (_mm_movemask_epi8(ok) != 0xffff) {
+      seq_int_t j = validate_nt_scalar(p, i, i + 16);
+      if (j >= 0)
+        return j;
+    }
+  }
+  return validate_nt_scalar(p, i, n);
+}
+
+__attribute__((target("avx2"))) static seq_int_t
+validate_nt_avx2(const char *p, seq_int_t n) {
+  const __m256i lower = _mm256_set1_epi8(0x20);
+  const __m256i a = _mm256_set1_epi8('a');
+  const __m256i c = _mm256_set1_epi8('c');
+  const __m256i g = _mm256_set1_epi8('g');
+  const __m256i t = _mm256_set1_epi8('t');
+  const __m256i N = _mm256_set1_epi8('n');
+  seq_int_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_or_si256(
+        _mm256_loadu_si256((const __m256i *)(p + i)), lower);
+    __m256i ok = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, a), _mm256_cmpeq_epi8(v, c)),
+        _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, g), _mm256_cmpeq_epi8(v, t)),
+            _mm256_cmpeq_epi8(v, N)));
+    if (_mm256_movemask_epi8(ok) != -1) {
+      seq_int_t j = validate_nt_scalar(p, i, i + 32);
+      if (j >= 0)
+        return j;
+    }
+  }
+  return validate_nt_scalar(p, i, n);
+}
+
+static seq_int_t validate_qual_sse2(const char *p, seq_int_t n) {
+  // signed compares also reject bytes >= 0x80
+  const __m128i lo = _mm_set1_epi8(0x20);
+  const __m128i hi = _mm_set1_epi8(0x7f);
+  seq_int_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmpgt_epi8(hi, v));
+    if (_mm_movemask_epi8(ok) != 0xffff)
+      return validate_qual_scalar(p, i, i + 16);
+  }
+  return validate_qual_scalar(p, i, n);
+}
+
+__attribute__((target("avx2"))) static seq_int_t
+validate_qual_avx2(const char *p, seq_int_t n) {
+  const __m256i lo = _mm256_set1_epi8(0x20);
+  const __m256i hi = _mm256_set1_epi8(0x7f);
+  seq_int_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i ok =
+        _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+    if (_mm256_movemask_epi8(ok) != -1)
+      return validate_qual_scalar(p, i, i + 32);
+  }
+  return validate_qual_scalar(p, i, n);
+}
+
+static void encode_nt4_sse2(const char *p, seq_int_t n, char *out) {
+  const __m128i lower = _mm_set1_epi8(0x20);
+  const __m128i a = _mm_set1_epi8('a');
+  const __m128i c = _mm_set1_epi8('c');
+  const __m128i g = _mm_set1_epi8('g');
+  const __m128i t = _mm_set1_epi8('t');
+  const __m128i three = _mm_set1_epi8(3);
+  const __m128i four = _mm_set1_epi8(4);
+  seq_int_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v =
+        _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)), lower);
+    __m128i ok =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, c)),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, g), _mm_cmpeq_epi8(v, t)));
+    // 16-bit shifts: bits pulled in from the neighbouring byte are masked off
+    __m128i code = _mm_and_si128(
+        _mm_xor_si128(_mm_srli_epi16(v, 1), _mm_srli_epi16(v, 2)), three);
+    code = _mm_or_si128(_mm_and_si128(ok, code), _mm_andnot_si128(ok, four));
+    _mm_storeu_si128((__m128i *)(out + i), code);
+  }
+  encode_nt4_scalar(p, i, n, out);
+}
+
+__attribute__((target("avx2"))) static void
+encode_nt4_avx2(const char *p, seq_int_t n, char *out) {
+  const __m256i lower = _mm256_set1_epi8(0x20);
+  const __m256i a = _mm256_set1_epi8('a');
+  const __m256i c = _mm256_set1_epi8('c');
+  const __m256i g = _mm256_set1_epi8('g');
+  const __m256i t = _mm256_set1_epi8('t');
+  const __m256i three = _mm256_set1_epi8(3);
+  const __m256i four = _mm256_set1_epi8(4);
+  seq_int_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_or_si256(
+        _mm256_loadu_si256((const __m256i *)(p + i)), lower);
+    __m256i ok = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, a), _mm256_cmpeq_epi8(v, c)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, g), _mm256_cmpeq_epi8(v, t)));
+    __m256i code = _mm256_and_si256(
+        _mm256_xor_si256(_mm256_srli_epi16(v, 1), _mm256_srli_epi16(v, 2)),
+        three);
+    code = _mm256_blendv_epi8(four, code, ok);
+    _mm256_storeu_si256((__m256i *)(out + i), code);
+  }
+  encode_nt4_scalar(p, i, n, out);
+}
+
+// __builtin_cpu_supports() needs __builtin_cpu_init() first when it may run
+// before constructors, so the check is made lazily on first use
+static bool has_avx2() {
+  static const bool avx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return avx2;
+}
+#endif
+
+// Returns the index of the first non-IUPAC nucleotide in p[0..n), or -1.
+SEQ_FUNC seq_int_t seq_validate_nt(const char *p, seq_int_t n) {
+#if defined(__x86_64__)
+  return has_avx2() ? validate_nt_avx2(p, n) : validate_nt_sse2(p, n);
+#else
+  return validate_nt_scalar(p, 0, n);
+#endif
+}
+
+// Writes the 2-bit code of each base of p[0..n) to out (see encode_nt4).
+SEQ_FUNC void seq_encode_nt4(const char *p, seq_int_t n, char *out) {
+#if defined(__x86_64__)
+  if (has_avx2())
+    encode_nt4_avx2(p, n, out);
+  else
+    encode_nt4_sse2(p, n, out);
+#else
+  encode_nt4_scalar(p, 0, n, out);
+#endif
+}
+
+// Returns the index of the first non-printable quality score, or -1.
+SEQ_FUNC seq_int_t seq_validate_qual(const char *p, seq_int_t n) {
+#if defined(__x86_64__)
+  return has_avx2() ? validate_qual_avx2(p, n) : validate_qual_sse2(p, n);
+#else
+  return validate_qual_scalar(p, 0, n);
+#endif
+}
+
+// Splits the next FASTQ record off p[0..n): the [start, end) offsets of up to
+// four lines (without newlines) are stored in `lines`, and the number of bytes
+// consumed in `used`. Returns the number of lines found, which is less than
+// four only for a truncated record at the end of the input.
+SEQ_FUNC seq_int_t seq_fastq_next(const char *p, seq_int_t n, seq_int_t *lines,
+                                  seq_int_t *used) {
+  seq_int_t pos = 0;
+  seq_int_t k = 0;
+  while (k < 4 && pos < n) {
+    auto *q = (const char *)memchr(p + pos, '\n', (size_t)(n - pos));
+    seq_int_t end = q ? (seq_int_t)(q - p) : n;
+    lines[2 * k] = pos;
+    lines[2 * k + 1] = end;
+    pos = q ? end + 1 : n;
+    ++k;
+  }
+  *used = pos;
+  return k;
+}
+
+// Returns the offset of the first FASTQ (fmt '@') or FASTA (fmt '>') record
+// starting at or after `off` in p[0..n), or n if there is none. Scanning
+// starts at the first line boundary at or after `off`. A FASTQ header must
+// be followed two lines later by a '+' separator, which rules out quality
+// lines that happen to start with '@'.
+SEQ_FUNC seq_int_t seq_fastx_sync(const char *p, seq_int_t n, seq_int_t off,
+                                  char fmt) {
+  seq_int_t pos = off;
+  while (pos < n) {
+    if (pos == 0 || p[pos - 1] == '\n') {
+      if (p[pos] == fmt) {
+        if (fmt != '@')
+          return pos;
+        seq_int_t lines[8];
+        seq_int_t used;
+        if (seq_fastq_next(p + pos, n - pos, lines, &used) < 3)
+          return n;
+        if (lines[5] > lines[4] && p[pos + lines[4]] == '+')
+          return pos;
+      }
+    }
+    auto *q = (const char *)memchr(p + pos, '\n', (size_t)(n - pos));
+    if (!q)
+      return n;
+    pos = (seq_int_t)(q - p) + 1;
+  }
+  return n;
+}
+
 /*
  * dlopen
  */
@@ -283,6 +734,383 @@ SEQ_FUNC void seq_rlock_release(void *lock) {
   m->unlock();
 }
 
+/*
+ * Task scheduler
+ *
+ * Parallel pipeline stages are outlined into task functions by the compiler
+ * (unless it's built with Tapir, which uses OpenMP instead) and spawned here.
+ * Each thread has its own deque: it pushes and pops tasks at the back, while
+ * idle threads steal from the front of others'. A task group is just a
+ * counter of unfinished tasks in the spawning frame; seq_sched_sync() runs
+ * tasks until its group's counter drops to zero. Thread 0 is whichever
+ * (non-worker) thread spawns tasks, normally the main thread, and the other
+ * threads are started on first use and registered with the GC.
+ */
+
+#if THREADED
+namespace {
+// spawning threads run tasks inline once this many are queued
+const size_t SCHED_MAX_QUEUED = 256;
+
+// finished tasks are kept for reuse by the thread that ran them, since
+// allocating and freeing uncollectable memory takes the GC's global lock
+const size_t SCHED_TASK_CACHE = 64;
+
+struct Task {
+  void (*fn)(void *);
+  seq_int_t *group;
+  seq_int_t capacity;
+  // followed by the task's arguments
+};
+
+struct TaskDeque {
+  mutex lock;
+  deque<Task *> tasks;
+};
+
+struct Scheduler {
+  int threads;
+  unique_ptr<TaskDeque[]> deques;
+  atomic<seq_int_t> queued;
+  atomic<int> sleeping;
+  mutex idleLock;
+  condition_variable idle;
+
+  explicit Scheduler(int threads)
+      : threads(threads), deques(new TaskDeque[threads]), queued(0),
+        sleeping(0), idleLock(), idle() {}
+};
+
+Scheduler *scheduler = nullptr;
+once_flag schedulerInit;
+thread_local int workerId = -1;
+thread_local int taskDepth = 0; // tasks running on this thread's stack
+thread_local vector<Task *> taskCache;
+
+Task *allocTask(seq_int_t size) {
+  if (!taskCache.empty() && taskCache.back()->capacity >= size) {
+    Task *task = taskCache.back();
+    taskCache.pop_back();
+    return task;
+  }
+  // the arguments may point to GC-allocated data, so the task has to be
+  // scanned, but must not be collected while it sits in a deque
+  auto *task = (Task *)GC_MALLOC_UNCOLLECTABLE(sizeof(Task) + size);
+  task->capacity = size;
+  return task;
+}
+
+void freeTask(Task *task) {
+  if (taskCache.size() < SCHED_TASK_CACHE) {
+    memset(task + 1, 0, (size_t)task->capacity); // don't keep arguments alive
+    taskCache.push_back(task);
+  } else {
+    GC_FREE(task);
+  }
+}
+
+Task *popTask(int self) {
+  TaskDeque &own = scheduler->deques[self];
+  {
+    lock_guard<mutex> guard(own.lock);
+    if (!own.tasks.empty()) {
+      Task *task = own.tasks.back();
+      own.tasks.pop_back();
+      --scheduler->queued;
+      return task;
+    }
+  }
+
+  const int n = scheduler->threads;
+  static thread_local unsigned seed = (unsigned)self + 1;
+  const int start = (int)(rand_r(&seed) % (unsigned)n);
+  for (int i = 0; i < n; i++) {
+    int victim = (start + i) % n;
+    if (victim == self)
+      continue;
+    TaskDeque &other = scheduler->deques[victim];
+    lock_guard<mutex> guard(other.lock);
+    if (!other.tasks.empty()) {
+      Task *task = other.tasks.front();
+      other.tasks.pop_front();
+      --scheduler->queued;
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void runTask(Task *task) {
+  ++taskDepth;
+  task->fn(task + 1);
+  --taskDepth;
+  __atomic_sub_fetch(task->group, 1, __ATOMIC_RELEASE);
+  freeTask(task);
+}
+
+void *workerMain(void *arg) {
+  workerId = (int)(intptr_t)arg;
+  while (true) {
+    if (Task *task = popTask(workerId)) {
+      runTask(task);
+      continue;
+    }
+    unique_lock<mutex> guard(scheduler->idleLock);
+    ++scheduler->sleeping;
+    scheduler->idle.wait(guard, [] { return scheduler->queued > 0; });
+    --scheduler->sleeping;
+  }
+  return nullptr;
+}
+
+void startScheduler() {
+  scheduler = new Scheduler(omp_get_max_threads());
+  for (int i = 1; i < scheduler->threads; i++) {
+    pthread_t thread;
+    pthread_create(&thread, nullptr, workerMain, (void *)(intptr_t)i);
+    pthread_detach(thread);
+  }
+}
+
+int selfId() { return workerId < 0 ? 0 : workerId; }
+} // namespace
+#endif
+
+SEQ_FUNC void seq_sched_spawn(seq_int_t *group, void (*fn)(void *), void *args,
+                              seq_int_t size) {
+#if THREADED
+  call_once(schedulerInit, startScheduler);
+  TaskDeque &own = scheduler->deques[selfId()];
+  if (scheduler->threads > 1) {
+    unique_lock<mutex> guard(own.lock);
+    if (own.tasks.size() < SCHED_MAX_QUEUED) {
+      Task *task = allocTask(size);
+      task->fn = fn;
+      task->group = group;
+      memcpy(task + 1, args, (size_t)size);
+      __atomic_add_fetch(group, 1, __ATOMIC_RELAXED);
+      own.tasks.push_back(task);
+      guard.unlock();
+
+      ++scheduler->queued;
+      if (scheduler->sleeping > 0) {
+        { lock_guard<mutex> idleGuard(scheduler->idleLock); }
+        scheduler->idle.notify_one();
+      }
+      return;
+    }
+  }
+  ++taskDepth;
+  fn(args);
+  --taskDepth;
+#else
+  fn(args);
+#endif
+}
+
+SEQ_FUNC void seq_sched_sync(seq_int_t *group) {
+#if THREADED
+  if (!scheduler)
+    return;
+  while (__atomic_load_n(group, __ATOMIC_ACQUIRE) > 0) {
+    if (Task *task = popTask(selfId()))
+      runTask(task);
+    else
+      this_thread::yield();
+  }
+#endif
+}
+
+SEQ_FUNC int seq_sched_num_threads() {
+#if THREADED
+  return scheduler ? scheduler->threads : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// threads in the team running the caller, like omp_get_num_threads(): the
+// whole pool inside a task, otherwise 1 (or the OpenMP team's size)
+SEQ_FUNC int seq_sched_team_size() {
+#if THREADED
+  return taskDepth > 0 ? scheduler->threads : omp_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
+SEQ_FUNC int seq_sched_thread_num() {
+#if THREADED
+  return workerId < 0 ? omp_get_thread_num() : workerId;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Parallel pipelines spawn generated values in chunks. Unless the grain is
+ * fixed, each pipeline keeps two counters, the nanoseconds its tasks have
+ * taken and the values they processed, and the chunk size is picked so that
+ * a task takes about SCHED_CHUNK_NS -- long enough to amortize spawning,
+ * short enough to balance the load. It at most doubles at each spawn so an
+ * early misestimate doesn't produce a few huge tasks.
+ */
+static const seq_int_t SCHED_CHUNK_NS = 50000;
+static const seq_int_t SCHED_MAX_GRAIN = SEQ_SCHED_MAX_GRAIN;
+
+SEQ_FUNC void seq_sched_chunk_done(seq_int_t *stats, seq_int_t n,
+                                   seq_int_t start) {
+  __atomic_add_fetch(&stats[0], seq_time_monotonic() - start,
+                     __ATOMIC_RELAXED);
+  __atomic_add_fetch(&stats[1], n, __ATOMIC_RELAXED);
+}
+
+SEQ_FUNC seq_int_t seq_sched_grain(seq_int_t *stats, seq_int_t grain) {
+  const seq_int_t ns = __atomic_load_n(&stats[0], __ATOMIC_RELAXED);
+  const seq_int_t n = __atomic_load_n(&stats[1], __ATOMIC_RELAXED);
+  if (n == 0) // nothing has finished yet
+    return grain;
+  seq_int_t target =
+      ns > 0 ? (seq_int_t)((double)SCHED_CHUNK_NS * n / ns) : SCHED_MAX_GRAIN;
+  target = min(target, min(2 * grain, SCHED_MAX_GRAIN));
+  return max(target, (seq_int_t)1);
+}
+
+/*
+ * Staged pipelines
+ *
+ * Stages of a staged pipeline run on their own threads and pass values
+ * through bounded FIFO queues of fixed-size items, which are copied in and
+ * out. put() blocks while a queue is full, so a slow stage holds back the
+ * ones before it, and get() blocks while it's empty until each of the
+ * queue's writers has closed it. Without THREADED, a stage "thread" runs to
+ * completion when it's started, so queues grow instead of blocking.
+ */
+
+namespace {
+struct ItemQueue {
+  mutex lock;
+  condition_variable notEmpty;
+  condition_variable notFull;
+  char *items;
+  seq_int_t itemSize;
+  seq_int_t capacity;
+  seq_int_t head;
+  seq_int_t size;
+  seq_int_t writers;
+  bool atomic;
+};
+
+struct ThreadStart {
+  void (*fn)(void *);
+  void *arg;
+};
+
+char *allocItems(ItemQueue *q, seq_int_t capacity) {
+  const size_t bytes = (size_t)(capacity * q->itemSize);
+  return (char *)(q->atomic ? seq_alloc_atomic(bytes) : seq_alloc(bytes));
+}
+
+#if !THREADED
+void growQueue(ItemQueue *q) {
+  char *items = allocItems(q, 2 * q->capacity);
+  for (seq_int_t i = 0; i < q->size; i++)
+    memcpy(items + i * q->itemSize,
+           q->items + ((q->head + i) % q->capacity) * q->itemSize,
+           (size_t)q->itemSize);
+  q->items = items;
+  q->head = 0;
+  q->capacity *= 2;
+}
+#endif
+
+void *threadMain(void *arg) {
+  auto *start = (ThreadStart *)arg;
+  start->fn(start->arg);
+  return nullptr;
+}
+} // namespace
+
+SEQ_FUNC void *seq_queue_new(seq_int_t capacity, seq_int_t itemSize,
+                             bool atomic, seq_int_t writers) {
+  // allocated like locks: the queue lives as long as its references
+  auto *q = new (seq_alloc(sizeof(ItemQueue))) ItemQueue();
+  q->itemSize = itemSize;
+  q->capacity = capacity;
+  q->head = 0;
+  q->size = 0;
+  q->writers = writers;
+  q->atomic = atomic;
+  q->items = allocItems(q, capacity);
+  return q;
+}
+
+SEQ_FUNC void seq_queue_put(void *queue, void *item) {
+  auto *q = (ItemQueue *)queue;
+  unique_lock<mutex> guard(q->lock);
+#if THREADED
+  q->notFull.wait(guard, [q] { return q->size < q->capacity; });
+#else
+  if (q->size == q->capacity)
+    growQueue(q);
+#endif
+  const seq_int_t tail = (q->head + q->size) % q->capacity;
+  memcpy(q->items + tail * q->itemSize, item, (size_t)q->itemSize);
+  ++q->size;
+  guard.unlock();
+  q->notEmpty.notify_one();
+}
+
+SEQ_FUNC bool seq_queue_get(void *queue, void *item) {
+  auto *q = (ItemQueue *)queue;
+  unique_lock<mutex> guard(q->lock);
+  q->notEmpty.wait(guard, [q] { return q->size > 0 || q->writers == 0; });
+  if (q->size == 0)
+    return false;
+  char *slot = q->items + q->head * q->itemSize;
+  memcpy(item, slot, (size_t)q->itemSize);
+  memset(slot, 0, (size_t)q->itemSize); // don't keep the item alive
+  q->head = (q->head + 1) % q->capacity;
+  --q->size;
+  guard.unlock();
+  q->notFull.notify_one();
+  return true;
+}
+
+SEQ_FUNC void seq_queue_close(void *queue) {
+  auto *q = (ItemQueue *)queue;
+  bool last;
+  {
+    lock_guard<mutex> guard(q->lock);
+    if (q->writers > 0)
+      --q->writers;
+    last = (q->writers == 0);
+  }
+  if (last)
+    q->notEmpty.notify_all();
+}
+
+SEQ_FUNC void *seq_thread_start(void (*fn)(void *), void *arg) {
+  auto *start = (ThreadStart *)seq_alloc(sizeof(ThreadStart));
+  start->fn = fn;
+  start->arg = arg;
+#if THREADED
+  auto *thread = (pthread_t *)seq_alloc_atomic(sizeof(pthread_t));
+  if (pthread_create(thread, nullptr, threadMain, start) != 0)
+    return nullptr;
+  return thread;
+#else
+  threadMain(start);
+  return start;
+#endif
+}
+
+SEQ_FUNC void seq_thread_join(void *thread) {
+#if THREADED
+  pthread_join(*(pthread_t *)thread, nullptr);
+#endif
+}
+
 /*
  * Alignment
  *
@@ -347,101 +1175,109 @@ struct Alignment {
   seq_int_t score;
 };
 
+// Reusable alignment state (see Aligner in stdlib/bio/align.seq); the CIGAR of
+// an alignment made with a workspace lives in its buffer until the next call.
+struct AlignWorkspace {
+  uint32_t *cigar;
+  int m_cigar;
+};
+
+SEQ_FUNC void *seq_align_workspace_new() {
+  auto *ws = (AlignWorkspace *)seq_alloc(sizeof(AlignWorkspace));
+  ws->cigar = nullptr;
+  ws->m_cigar = 0;
+  return ws;
+}
+
+// sequences are encoded into, and aligned with, the thread's scratch arena;
+// the CIGAR goes into the workspace's buffer if one is given
 #define ALIGN_ENCODE(enc_func)                                                 \
-  uint8_t static_qbuf[128];                                                    \
-  uint8_t static_tbuf[128];                                                    \
+  SeqScratchScope scratch;                                                     \
+  ksw_extz_t ez;                                                               \
+  ez.cigar = ws ? ((AlignWorkspace *)ws)->cigar : nullptr;                     \
+  ez.m_cigar = ws ? ((AlignWorkspace *)ws)->m_cigar : 0;                       \
+  ez.n_cigar = 0;                                                              \
   const int qlen = abs(query.len);                                             \
   const int tlen = abs(target.len);                                            \
-  uint8_t *qbuf = qlen <= sizeof(static_qbuf)                                  \
-                      ? &static_qbuf[0]                                        \
-                      : (uint8_t *)seq_alloc_atomic(qlen);                     \
-  uint8_t *tbuf = tlen <= sizeof(static_tbuf)                                  \
-                      ? &static_tbuf[0]                                        \
-                      : (uint8_t *)seq_alloc_atomic(tlen);                     \
+  auto *qbuf = (uint8_t *)scratch.alloc(qlen);                                 \
+  auto *tbuf = (uint8_t *)scratch.alloc(tlen);                                 \
   (enc_func)(query, qbuf);                                                     \
   (enc_func)(target, tbuf)
 
-#define ALIGN_RELEASE()                                                        \
-  if (qbuf != &static_qbuf[0])                                                 \
-    seq_free(qbuf);                                                            \
-  if (tbuf != &static_tbuf[0])                                                 \
-  seq_free(tbuf)
+#define ALIGN_RETURN(score)                                                    \
+  do {                                                                         \
+    if (ws) {                                                                  \
+      ((AlignWorkspace *)ws)->cigar = ez.cigar;                                \
+      ((AlignWorkspace *)ws)->m_cigar = ez.m_cigar;                            \
+    }                                                                          \
+    *out = {{ez.cigar, ez.n_cigar}, (score)};                                  \
+  } while (0)
 
 SEQ_FUNC void seq_align(seq_t query, seq_t target, int8_t *mat, int8_t gapo,
                         int8_t gape, seq_int_t bandwidth, seq_int_t zdrop,
-                        seq_int_t end_bonus, seq_int_t flags, Alignment *out) {
-  ksw_extz_t ez;
+                        seq_int_t end_bonus, seq_int_t flags, void *ws,
+                        Alignment *out) {
   ALIGN_ENCODE(encode);
-  ksw_extz2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, gapo, gape,
+  ksw_extz2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 5, mat, gapo, gape,
                 (int)bandwidth, (int)zdrop, end_bonus, (int)flags, &ez);
-  ALIGN_RELEASE();
-  *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
+  ALIGN_RETURN(flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score);
 }
 
-SEQ_FUNC void seq_align_default(seq_t query, seq_t target, Alignment *out) {
+SEQ_FUNC void seq_align_default(seq_t query, seq_t target, void *ws,
+                                Alignment *out) {
   static const int8_t mat[] = {0,  -1, -1, -1, -1, -1, 0,  -1, -1,
                                -1, -1, -1, 0,  -1, -1, -1, -1, -1,
                                0,  -1, -1, -1, -1, -1, -1};
-  int m_cigar = 0;
-  int n_cigar = 0;
-  uint32_t *cigar = nullptr;
   ALIGN_ENCODE(encode);
-  int score = ksw_gg2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, 0, 1, -1,
-                          &m_cigar, &n_cigar, &cigar);
-  ALIGN_RELEASE();
-  *out = {{cigar, n_cigar}, score};
+  int score = ksw_gg2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 5, mat, 0, 1, -1,
+                          &ez.m_cigar, &ez.n_cigar, &ez.cigar);
+  ALIGN_RETURN(score);
 }
 
 SEQ_FUNC void seq_align_dual(seq_t query, seq_t target, int8_t *mat,
                              int8_t gapo1, int8_t gape1, int8_t gapo2,
                              int8_t gape2, seq_int_t bandwidth, seq_int_t zdrop,
-                             seq_int_t end_bonus, seq_int_t flags,
+                             seq_int_t end_bonus, seq_int_t flags, void *ws,
                              Alignment *out) {
-  ksw_extz_t ez;
   ALIGN_ENCODE(encode);
-  ksw_extd2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2,
+  ksw_extd2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2,
                 gape2, (int)bandwidth, (int)zdrop, end_bonus, (int)flags, &ez);
-  ALIGN_RELEASE();
-  *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
+  ALIGN_RETURN(flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score);
 }
 
 SEQ_FUNC void seq_align_splice(seq_t query, seq_t target, int8_t *mat,
                                int8_t gapo1, int8_t gape1, int8_t gapo2,
                                int8_t noncan, seq_int_t zdrop, seq_int_t flags,
-                               Alignment *out) {
-  ksw_extz_t ez;
+                               void *ws, Alignment *out) {
   ALIGN_ENCODE(encode);
-  ksw_exts2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2,
+  ksw_exts2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2,
                 noncan, (int)zdrop, (int)flags, &ez);
-  ALIGN_RELEASE();
-  *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
+  ALIGN_RETURN(flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score);
 }
 
 SEQ_FUNC void seq_align_global(seq_t query, seq_t target, int8_t *mat,
                                int8_t gapo, int8_t gape, seq_int_t bandwidth,
-                               bool backtrace, Alignment *out) {
-  int m_cigar = 0;
-  int n_cigar = 0;
-  uint32_t *cigar = nullptr;
+                               bool backtrace, void *ws, Alignment *out) {
   ALIGN_ENCODE(encode);
-  int score = ksw_gg2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, gapo, gape,
-                          (int)bandwidth, &m_cigar, &n_cigar, &cigar);
-  ALIGN_RELEASE();
-  *out = {{backtrace ? cigar : nullptr, backtrace ? n_cigar : 0}, score};
+  int score = ksw_gg2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 5, mat, gapo, gape,
+                          (int)bandwidth, &ez.m_cigar, &ez.n_cigar, &ez.cigar);
+  if (!backtrace)
+    ez.n_cigar = 0;
+  ALIGN_RETURN(score);
 }
 
 SEQ_FUNC void seq_palign(seq_t query, seq_t target, int8_t *mat, int8_t gapo,
                          int8_t gape, seq_int_t bandwidth, seq_int_t zdrop,
-                         seq_int_t end_bonus, seq_int_t flags, Alignment *out) {
-  ksw_extz_t ez;
+                         seq_int_t end_bonus, seq_int_t flags, void *ws,
+                         Alignment *out) {
   ALIGN_ENCODE(pencode);
-  ksw_extz2_sse(nullptr, qlen, qbuf, tlen, tbuf, 23, mat, gapo, gape,
+  ksw_extz2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 23, mat, gapo, gape,
                 (int)bandwidth, (int)zdrop, end_bonus, (int)flags, &ez);
-  ALIGN_RELEASE();
-  *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
+  ALIGN_RETURN(flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score);
 }
 
-SEQ_FUNC void seq_palign_default(seq_t query, seq_t target, Alignment *out) {
+SEQ_FUNC void seq_palign_default(seq_t query, seq_t target, void *ws,
+                                 Alignment *out) {
   // Blosum-62
   static const int8_t mat[] = {
       4,  -2, 0,  -2, -1, -2, 0,  -2, -1, -1, -1, -1, -2, -1, -1, -1, 1,  0,
@@ -474,38 +1310,30 @@ SEQ_FUNC void seq_palign_default(seq_t query, seq_t target, Alignment *out) {
       -3, -2, 3,  -3, 2,  -1, -2, -1, -1, -2, -3, -1, -2, -2, -2, -1, 2,  -1,
       7,  -2, -1, 1,  -3, 1,  4,  -3, -2, 0,  -3, 1,  -3, -1, 0,  -1, 3,  0,
       0,  -1, -2, -3, -1, -2, 4};
-  ksw_extz_t ez;
   ALIGN_ENCODE(pencode);
-  ksw_extz2_sse(nullptr, qlen, qbuf, tlen, tbuf, 23, mat, 11, 1, -1, -1,
+  ksw_extz2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 23, mat, 11, 1, -1, -1,
                 /* end_bonus */ 0, 0, &ez);
-  ALIGN_RELEASE();
-  *out = {{ez.cigar, ez.n_cigar}, ez.score};
+  ALIGN_RETURN(ez.score);
 }
 
 SEQ_FUNC void seq_palign_dual(seq_t query, seq_t target, int8_t *mat,
                               int8_t gapo1, int8_t gape1, int8_t gapo2,
                               int8_t gape2, seq_int_t bandwidth,
                               seq_int_t zdrop, seq_int_t end_bonus,
-                              seq_int_t flags, Alignment *out) {
-  ksw_extz_t ez;
+                              seq_int_t flags, void *ws, Alignment *out) {
   ALIGN_ENCODE(pencode);
-  ksw_extd2_sse(nullptr, qlen, qbuf, tlen, tbuf, 23, mat, gapo1, gape1, gapo2,
+  ksw_extd2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 23, mat, gapo1, gape1, gapo2,
                 gape2, (int)bandwidth, (int)zdrop, end_bonus, (int)flags, &ez);
-  ALIGN_RELEASE();
-  *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
+  ALIGN_RETURN(flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score);
 }
 
 SEQ_FUNC void seq_palign_global(seq_t query, seq_t target, int8_t *mat,
                                 int8_t gapo, int8_t gape, seq_int_t bandwidth,
-                                Alignment *out) {
-  int m_cigar = 0;
-  int n_cigar = 0;
-  uint32_t *cigar = nullptr;
+                                void *ws, Alignment *out) {
   ALIGN_ENCODE(pencode);
-  int score = ksw_gg2_sse(nullptr, qlen, qbuf, tlen, tbuf, 23, mat, gapo, gape,
-                          (int)bandwidth, &m_cigar, &n_cigar, &cigar);
-  ALIGN_RELEASE();
-  *out = {{cigar, n_cigar}, score};
+  int score = ksw_gg2_sse(scratch.get(), qlen, qbuf, tlen, tbuf, 23, mat, gapo, gape,
+                          (int)bandwidth, &ez.m_cigar, &ez.n_cigar, &ez.cigar);
+  ALIGN_RETURN(score);
 }
 
 SEQ_FUNC bool seq_is_macos() {
@@ -34,6 +34,32 @@ SEQ_FUNC void *seq_realloc(void *p, size_t n);
 SEQ_FUNC void seq_free(void *p);
 SEQ_FUNC void seq_register_finalizer(void *p, void (*f)(void *obj, void *data));
 
+SEQ_FUNC void *seq_arena_new();
+SEQ_FUNC void *seq_arena_alloc(void *arena, size_t n);
+SEQ_FUNC void seq_arena_reset(void *arena);
+SEQ_FUNC void seq_arena_free(void *arena);
+SEQ_FUNC void *seq_arena_scratch_enter();
+SEQ_FUNC void seq_arena_scratch_exit();
+
+// Scope in which runtime code can allocate temporaries from the calling
+// thread's scratch arena; they're freed when the outermost scope ends.
+class SeqScratchScope {
+  void *arena;
+
+public:
+  SeqScratchScope() : arena(seq_arena_scratch_enter()) {}
+  ~SeqScratchScope() { seq_arena_scratch_exit(); }
+  SeqScratchScope(const SeqScratchScope &) = delete;
+  SeqScratchScope &operator=(const SeqScratchScope &) = delete;
+
+  void *get() const { return arena; }
+  void *alloc(size_t n) const { return seq_arena_alloc(arena, n); }
+};
+
+// Type index of the handler wrapped around main: it catches everything, like
+// a bare except, and tells the runtime the exception is about to terminate.
+#define SEQ_EXC_TYPE_TERMINATE 1
+
 SEQ_FUNC void *seq_alloc_exc(int type, void *obj);
 SEQ_FUNC void seq_throw(void *exc);
 SEQ_FUNC _Unwind_Reason_Code seq_personality(int version,
@@ -44,6 +70,28 @@ SEQ_FUNC _Unwind_Reason_Code seq_personality(int version,
 SEQ_FUNC int64_t seq_exc_offset();
 SEQ_FUNC uint64_t seq_exc_class();
 
+// Largest chunk of values a parallel pipeline spawns as one task, whether
+// its grain is fixed with @parallel(N) or adapted as it runs.
+#define SEQ_SCHED_MAX_GRAIN (1 << 16)
+
+SEQ_FUNC void seq_sched_spawn(seq_int_t *group, void (*fn)(void *), void *args,
+                              seq_int_t size);
+SEQ_FUNC void seq_sched_sync(seq_int_t *group);
+SEQ_FUNC int seq_sched_num_threads();
+SEQ_FUNC int seq_sched_team_size();
+SEQ_FUNC int seq_sched_thread_num();
+SEQ_FUNC void seq_sched_chunk_done(seq_int_t *stats, seq_int_t n,
+                                   seq_int_t start);
+SEQ_FUNC seq_int_t seq_sched_grain(seq_int_t *stats, seq_int_t grain);
+
+SEQ_FUNC void *seq_queue_new(seq_int_t capacity, seq_int_t itemSize,
+                             bool atomic, seq_int_t writers);
+SEQ_FUNC void seq_queue_put(void *queue, void *item);
+SEQ_FUNC bool seq_queue_get(void *queue, void *item);
+SEQ_FUNC void seq_queue_close(void *queue);
+SEQ_FUNC void *seq_thread_start(void (*fn)(void *), void *arg);
+SEQ_FUNC void seq_thread_join(void *thread);
+
 SEQ_FUNC seq_str_t seq_str_int(seq_int_t n);
 SEQ_FUNC seq_str_t seq_str_float(double f);
 SEQ_FUNC seq_str_t seq_str_bool(bool b);
@@ -53,4 +101,9 @@ SEQ_FUNC seq_str_t seq_str_tuple(seq_str_t *strs, seq_int_t n);
 
 SEQ_FUNC void seq_print(seq_str_t str);
 
+SEQ_FUNC seq_int_t seq_fastq_next(const char *p, seq_int_t n, seq_int_t *lines,
+                                  seq_int_t *used);
+SEQ_FUNC seq_int_t seq_fastx_sync(const char *p, seq_int_t n, seq_int_t off,
+                                  char fmt);
+
 #endif /* SEQ_LIB_H */
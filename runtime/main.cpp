@@ -20,6 +20,15 @@ static void versMsg(raw_ostream &out) {
       << SEQ_VERSION_PATCH << "\n";
 }
 
+// GC settings are passed to the runtime through the environment variables
+// that Boehm GC reads when it's initialized
+static bool setGCEnv(const char *name, const string &value) {
+  if (value.empty())
+    return false;
+  setenv(name, value.c_str(), /*overwrite=*/1);
+  return true;
+}
+
 int main(int argc, char **argv) {
   opt<string> input(Positional, desc("<input file>"), init("-"));
   opt<bool> debug("d", desc("Compile in debug mode (disable optimizations; "
@@ -29,6 +38,15 @@ int main(int argc, char **argv) {
       "o",
       desc("Write LLVM bitcode to specified file instead of running with JIT"));
   cl::list<string> libs("L", desc("Load and link the specified library"));
+  opt<string> gcHeap("gc-heap",
+                     desc("Initial GC heap size, e.g. 4G (JIT only)"));
+  opt<string> gcDivisor(
+      "gc-divisor", desc("GC free space divisor; larger values collect more "
+                         "often but use less memory (JIT only)"));
+  opt<string> gcMarkers("gc-markers",
+                        desc("Number of GC marker threads (JIT only)"));
+  opt<bool> gcIncremental("gc-incremental",
+                          desc("Use incremental GC (JIT only)"));
   cl::list<string> args(ConsumeAfter, desc("<program arguments>..."));
 
   SetVersionPrinter(versMsg);
@@ -41,6 +59,12 @@ int main(int argc, char **argv) {
     return EXIT_SUCCESS;
   }
 
+  bool gc = setGCEnv("GC_INITIAL_HEAP_SIZE", gcHeap.getValue());
+  gc = setGCEnv("GC_FREE_SPACE_DIVISOR", gcDivisor.getValue()) || gc;
+  gc = setGCEnv("GC_MARKERS", gcMarkers.getValue()) || gc;
+  gc = setGCEnv("GC_ENABLE_INCREMENTAL", gcIncremental.getValue() ? "1" : "") ||
+       gc;
+
   SeqModule *s = parse(argv[0], input.c_str(), false, false);
   if (output.getValue().empty()) {
     argsVec.insert(argsVec.begin(), input);
@@ -52,6 +76,10 @@ int main(int argc, char **argv) {
     if (!argsVec.empty())
       compilationWarning("ignoring arguments during compilation");
 
+    if (gc)
+      compilationWarning("ignoring GC options during compilation (set GC_* "
+                         "environment variables when running instead)");
+
     compile(s, output.getValue(), debug.getValue());
   }
 
@@ -1,65 +1,57 @@
 #include "intersw.h"
 #include "ksw2.h"
 #include "lib.h"
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 
-struct InterAlignParams { // must be consistent with bio/align.seq
-  int8_t a;
-  int8_t b;
-  int8_t ambig;
-  int8_t gapo;
-  int8_t gape;
-  int8_t score_only;
-  int32_t bandwidth;
-  int32_t zdrop;
-  int32_t end_bonus;
-};
+namespace {
+enum class ISA { NONE, SSE41, AVX2, AVX512BW };
 
-SEQ_FUNC void seq_inter_align128(InterAlignParams *paramsx,
-                                 SeqPair *seqPairArray, uint8_t *seqBufRef,
-                                 uint8_t *seqBufQer, int numPairs) {
-  InterAlignParams params = *paramsx;
-  const int8_t bandwidth = (0 <= params.bandwidth && params.bandwidth < 0xff)
-                               ? params.bandwidth
-                               : 0x7f;
-  const int8_t zdrop =
-      (0 <= params.zdrop && params.zdrop < 0xff) ? params.zdrop : 0x7f;
-  if (params.score_only) {
-    SW8 bsw(params.gapo, params.gape, params.gapo, params.gape, zdrop,
-            params.end_bonus, params.a, params.b, params.ambig);
-    bsw.SW(seqPairArray, seqBufRef, seqBufQer, numPairs, bandwidth);
-  } else {
-    SWbt8 bsw(params.gapo, params.gape, params.gapo, params.gape, zdrop,
-              params.end_bonus, params.a, params.b, params.ambig);
-    bsw.SW(seqPairArray, seqBufRef, seqBufQer, numPairs, bandwidth);
+/*
+ * Widest instruction set supported by the CPU. Setting SEQ_INTERALIGN_ISA
+ * to "sse4.1", "avx2" or "avx512bw" caps it, e.g. for benchmarking; any
+ * other value (like "none") falls back to the non-batched kernel.
+ */
+ISA detectISA() {
+  __builtin_cpu_init();
+  ISA isa = ISA::NONE;
+  if (__builtin_cpu_supports("avx512bw"))
+    isa = ISA::AVX512BW;
+  else if (__builtin_cpu_supports("avx2"))
+    isa = ISA::AVX2;
+  else if (__builtin_cpu_supports("sse4.1"))
+    isa = ISA::SSE41;
+
+  const char *cap = getenv("SEQ_INTERALIGN_ISA");
+  if (cap && *cap) {
+    ISA max = ISA::NONE;
+    if (strcmp(cap, "avx512bw") == 0)
+      max = ISA::AVX512BW;
+    else if (strcmp(cap, "avx2") == 0)
+      max = ISA::AVX2;
+    else if (strcmp(cap, "sse4.1") == 0)
+      max = ISA::SSE41;
+    if (max < isa)
+      isa = max;
   }
+  return isa;
 }
 
-SEQ_FUNC void seq_inter_align16(InterAlignParams *paramsx,
-                                SeqPair *seqPairArray, uint8_t *seqBufRef,
-                                uint8_t *seqBufQer, int numPairs) {
-  InterAlignParams params = *paramsx;
-  const int16_t bandwidth = (0 <= params.bandwidth && params.bandwidth < 0xffff)
-                                ? params.bandwidth
-                                : 0x7fff;
-  const int16_t zdrop =
-      (0 <= params.zdrop && params.zdrop < 0xffff) ? params.zdrop : 0x7fff;
-  if (params.score_only) {
-    SW16 bsw(params.gapo, params.gape, params.gapo, params.gape, zdrop,
-             params.end_bonus, params.a, params.b, params.ambig);
-    bsw.SW(seqPairArray, seqBufRef, seqBufQer, numPairs, bandwidth);
-  } else {
-    SWbt16 bsw(params.gapo, params.gape, params.gapo, params.gape, zdrop,
-               params.end_bonus, params.a, params.b, params.ambig);
-    bsw.SW(seqPairArray, seqBufRef, seqBufQer, numPairs, bandwidth);
-  }
+ISA getISA() {
+  static const ISA isa = detectISA();
+  return isa;
 }
+} // namespace
 
-SEQ_FUNC void seq_inter_align1(InterAlignParams *paramsx, SeqPair *seqPairArray,
-                               uint8_t *seqBufRef, uint8_t *seqBufQer,
-                               int numPairs) {
-  InterAlignParams params = *paramsx;
+/*
+ * Aligns pairs one at a time with ksw2's banded SSE kernel. seqRef/seqQer
+ * give the (2-bit encoded) reference and query of the i-th pair.
+ */
+template <typename SeqRef, typename SeqQer>
+static void alignPairs(const InterAlignParams &params, SeqPair *seqPairArray,
+                       int numPairs, SeqRef seqRef, SeqQer seqQer) {
   int8_t a = params.a > 0 ? params.a : -params.a;
   int8_t b = params.b > 0 ? -params.b : params.b;
   int8_t ambig = params.ambig > 0 ? -params.ambig : params.ambig;
@@ -71,13 +63,195 @@ SEQ_FUNC void seq_inter_align1(InterAlignParams *paramsx, SeqPair *seqPairArray,
   for (int i = 0; i < numPairs; i++) {
     SeqPair *sp = &seqPairArray[i];
     int myflags = flags | sp->flags;
-    ksw_reset_extz(&ez);
-    ksw_extz2_sse(nullptr, sp->len2, seqBufQer + SW8::LEN_LIMIT * sp->id,
-                  sp->len1, seqBufRef + SW8::LEN_LIMIT * sp->id, /*m=*/5, mat,
-                  params.gapo, params.gape, params.bandwidth, params.zdrop,
-                  params.end_bonus, myflags, &ez);
+    ez.cigar = nullptr; // each pair gets its own CIGAR
+    ez.m_cigar = 0;
+    SeqScratchScope scratch;
+    ksw_extz2_sse(scratch.get(), sp->len2, seqQer(*sp), sp->len1, seqRef(*sp),
+                  /*m=*/5, mat, params.gapo, params.gape, params.bandwidth,
+                  params.zdrop, params.end_bonus, myflags, &ez);
     sp->score = (myflags & KSW_EZ_EXTZ_ONLY) ? ez.max : ez.score;
     sp->cigar = ez.cigar;
     sp->n_cigar = ez.n_cigar;
   }
 }
+
+SEQ_FUNC void seq_inter_align1(InterAlignParams *paramsx, SeqPair *seqPairArray,
+                               uint8_t *seqBufRef, uint8_t *seqBufQer,
+                               int numPairs) {
+  alignPairs(
+      *paramsx, seqPairArray, numPairs,
+      [=](const SeqPair &sp) {
+        return seqBufRef + INTER_ALIGN_LEN_LIMIT * sp.id;
+      },
+      [=](const SeqPair &sp) {
+        return seqBufQer + INTER_ALIGN_LEN_LIMIT * sp.id;
+      });
+}
+
+namespace {
+// the long bucket is aligned in tasks of one SIMD batch (or, for pairs the
+// 16-bit kernel can't take, of one pair) spread over the scheduler's threads
+struct LongTask {
+  const InterAlignParams *params;
+  SeqPair *pairs;
+  uint8_t **seqBufLong;
+  int numPairs;
+  ISA isa;
+};
+
+// traceback cells per pair the 16-bit kernel may keep for a long pair
+const size_t LONG_MAX_CELLS = 1 << 20;
+
+/*
+ * Whether the 16-bit inter-sequence kernel can align the given long pair
+ * just as ksw2 would: z-drop must be off (the kernel tests it by row, not
+ * by anti-diagonal), the pair has to fit the kernel's SoA buffers, scores
+ * along the band (best and worst) must stay clear of its -2^14 sentinel
+ * and, with CIGAR output, the banded traceback matrix must stay small.
+ */
+bool fitsLong16(const InterAlignParams &params, const SeqPair &sp) {
+  const int64_t maxLen = std::max(sp.len1, sp.len2);
+  if (params.zdrop >= 0 || maxLen >= 32768 || params.end_bonus < 0)
+    return false;
+  const int64_t band = (0 <= params.bandwidth && params.bandwidth < maxLen)
+                           ? params.bandwidth
+                           : maxLen;
+  const int64_t gapo = abs(params.gapo), gape = abs(params.gape);
+  const int64_t m = std::max({abs(params.a), abs(params.b), abs(params.ambig),
+                              abs(params.gape)});
+  if (m * maxLen + 2 * (gapo + gape) + gape * band + params.end_bonus >=
+      (1 << 14))
+    return false;
+  return params.score_only ||
+         (size_t)(maxLen * std::min(2 * band + 1, maxLen)) <= LONG_MAX_CELLS;
+}
+
+size_t isaLanes(ISA isa) {
+  switch (isa) {
+  case ISA::AVX512BW:
+    return 512 / 16;
+  case ISA::AVX2:
+    return 256 / 16;
+  default:
+    return 128 / 16;
+  }
+}
+
+void alignLongTask(void *arg) {
+  LongTask *task = (LongTask *)arg;
+  switch (task->isa) {
+  case ISA::AVX512BW:
+    interAlignLong16<512>(*task->params, task->pairs, task->seqBufLong,
+                          task->numPairs);
+    break;
+  case ISA::AVX2:
+    interAlignLong16<256>(*task->params, task->pairs, task->seqBufLong,
+                          task->numPairs);
+    break;
+  case ISA::SSE41:
+    interAlignLong16<128>(*task->params, task->pairs, task->seqBufLong,
+                          task->numPairs);
+    break;
+  default: {
+    uint8_t **seqBufLong = task->seqBufLong;
+    alignPairs(
+        *task->params, task->pairs, task->numPairs,
+        [=](const SeqPair &sp) { return seqBufLong[sp.id]; },
+        [=](const SeqPair &sp) { return seqBufLong[sp.id] + sp.len1; });
+    break;
+  }
+  }
+}
+} // namespace
+
+/*
+ * Pairs longer than INTER_ALIGN_LEN_LIMIT don't fit the inter-sequence
+ * kernels' fixed-size slots, so they get a batch of their own.
+ * seqBufLong[id] holds the reference followed by the query. Pairs within
+ * the 16-bit kernel's limits (see fitsLong16) are aligned across SIMD lanes
+ * like short ones, keeping only their band for the traceback; the rest
+ * take ksw2's per-pair kernel. Either way, the work is spread over the
+ * scheduler's threads.
+ */
+SEQ_FUNC void seq_inter_align_long(InterAlignParams *paramsx,
+                                   SeqPair *seqPairArray, uint8_t **seqBufLong,
+                                   int numPairs) {
+  const ISA isa = getISA();
+  // kernel-bound pairs are gathered by length, so that lanes finish
+  // together, into a GC-scanned copy that keeps their CIGARs alive. Longest
+  // first, so each thread sizes its traceback matrix once.
+  int *order = (int *)seq_alloc_atomic(numPairs * sizeof(int));
+  int numSIMD = 0, numOther = numPairs;
+  for (int i = 0; i < numPairs; i++) {
+    if (isa != ISA::NONE && fitsLong16(*paramsx, seqPairArray[i]))
+      order[numSIMD++] = i;
+    else
+      order[--numOther] = i;
+  }
+  std::sort(order, order + numSIMD, [=](int i, int j) {
+    const SeqPair &p = seqPairArray[i], &q = seqPairArray[j];
+    return std::max(p.len1, p.len2) > std::max(q.len1, q.len2);
+  });
+  SeqPair *simdPairs = (SeqPair *)seq_alloc(numSIMD * sizeof(SeqPair) + 1);
+  for (int i = 0; i < numSIMD; i++)
+    simdPairs[i] = seqPairArray[order[i]];
+
+  seq_int_t group = 0;
+  const int lanes = (int)isaLanes(isa);
+  for (int i = 0; i < numSIMD; i += lanes) {
+    LongTask task = {paramsx, simdPairs + i, seqBufLong,
+                     std::min(numSIMD - i, lanes), isa};
+    seq_sched_spawn(&group, alignLongTask, &task, sizeof(task));
+  }
+  for (int i = numSIMD; i < numPairs; i++) {
+    LongTask task = {paramsx, seqPairArray + order[i], seqBufLong, 1,
+                     ISA::NONE};
+    seq_sched_spawn(&group, alignLongTask, &task, sizeof(task));
+  }
+  seq_sched_sync(&group);
+
+  for (int i = 0; i < numSIMD; i++) {
+    SeqPair *sp = &seqPairArray[order[i]];
+    sp->score = simdPairs[i].score;
+    sp->cigar = simdPairs[i].cigar;
+    sp->n_cigar = simdPairs[i].n_cigar;
+  }
+}
+
+SEQ_FUNC void seq_inter_align128(InterAlignParams *paramsx,
+                                 SeqPair *seqPairArray, uint8_t *seqBufRef,
+                                 uint8_t *seqBufQer, int numPairs) {
+  switch (getISA()) {
+  case ISA::AVX512BW:
+    interAlign8<512>(*paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+    break;
+  case ISA::AVX2:
+    interAlign8<256>(*paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+    break;
+  case ISA::SSE41:
+    interAlign8<128>(*paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+    break;
+  default:
+    seq_inter_align1(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+    break;
+  }
+}
+
+SEQ_FUNC void seq_inter_align16(InterAlignParams *paramsx,
+                                SeqPair *seqPairArray, uint8_t *seqBufRef,
+                                uint8_t *seqBufQer, int numPairs) {
+  switch (getISA()) {
+  case ISA::AVX512BW:
+    interAlign16<512>(*paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+    break;
+  case ISA::AVX2:
+    interAlign16<256>(*paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+    break;
+  case ISA::SSE41:
+    interAlign16<128>(*paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+    break;
+  default:
+    seq_inter_align1(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+    break;
+  }
+}
@@ -0,0 +1,12 @@
+// 256-bit inter-sequence alignment kernels; compiled with AVX2 enabled
+#include "intersw_kernels.h"
+
+template void interAlign8<256>(const InterAlignParams &params,
+                               SeqPair *seqPairArray, uint8_t *seqBufRef,
+                               uint8_t *seqBufQer, int numPairs);
+template void interAlign16<256>(const InterAlignParams &params,
+                                SeqPair *seqPairArray, uint8_t *seqBufRef,
+                                uint8_t *seqBufQer, int numPairs);
+template void interAlignLong16<256>(const InterAlignParams &params,
+                                    SeqPair *seqPairArray, uint8_t **seqBufLong,
+                                    int numPairs);
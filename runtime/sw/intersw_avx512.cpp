@@ -0,0 +1,12 @@
+// 512-bit inter-sequence alignment kernels; compiled with AVX-512BW enabled
+#include "intersw_kernels.h"
+
+template void interAlign8<512>(const InterAlignParams &params,
+                               SeqPair *seqPairArray, uint8_t *seqBufRef,
+                               uint8_t *seqBufQer, int numPairs);
+template void interAlign16<512>(const InterAlignParams &params,
+                                SeqPair *seqPairArray, uint8_t *seqBufRef,
+                                uint8_t *seqBufQer, int numPairs);
+template void interAlignLong16<512>(const InterAlignParams &params,
+                                    SeqPair *seqPairArray, uint8_t **seqBufLong,
+                                    int numPairs);
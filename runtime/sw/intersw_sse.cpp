@@ -0,0 +1,12 @@
+// 128-bit inter-sequence alignment kernels; compiled with SSE4.1 enabled
+#include "intersw_kernels.h"
+
+template void interAlign8<128>(const InterAlignParams &params,
+                               SeqPair *seqPairArray, uint8_t *seqBufRef,
+                               uint8_t *seqBufQer, int numPairs);
+template void interAlign16<128>(const InterAlignParams &params,
+                                SeqPair *seqPairArray, uint8_t *seqBufRef,
+                                uint8_t *seqBufQer, int numPairs);
+template void interAlignLong16<128>(const InterAlignParams &params,
+                                    SeqPair *seqPairArray, uint8_t **seqBufLong,
+                                    int numPairs);
@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #define KSW_NEG_INF (-0x40000000)
 
@@ -119,18 +120,26 @@ extern "C" void *seq_alloc_atomic(size_t n);
 extern "C" void *seq_calloc_atomic(size_t m, size_t n);
 extern "C" void *seq_realloc(void *p, size_t n);
 extern "C" void seq_free(void *p);
-#define kmalloc(km, size) seq_alloc_atomic((size))
-#define kcalloc(km, count, size) seq_calloc_atomic((count), (size))
+extern "C" void *seq_arena_alloc(void *arena, size_t n);
+// km is a runtime arena (see lib.h), or null to allocate from the GC; arena
+// memory is freed along with the arena rather than by kfree
+#define kmalloc(km, size)                                                      \
+  ((km) ? seq_arena_alloc((km), (size)) : seq_alloc_atomic((size)))
+#define kcalloc(km, count, size)                                               \
+  ((km) ? memset(seq_arena_alloc((km), (count) * (size)), 0,                  \
+                 (count) * (size))                                             \
+        : seq_calloc_atomic((count), (size)))
 #define krealloc(km, ptr, size) seq_realloc((ptr), (size))
-#define kfree(km, ptr) seq_free((ptr))
+#define kfree(km, ptr) ((km) ? (void)0 : seq_free((ptr)))
 
 static inline uint32_t *ksw_push_cigar(void *km, int *n_cigar, int *m_cigar,
                                        uint32_t *cigar, uint32_t op, int len) {
   if (*n_cigar == 0 || op != (cigar[(*n_cigar) - 1] & 0xf)) {
     if (*n_cigar == *m_cigar) {
       *m_cigar = *m_cigar ? (*m_cigar) << 1 : 4;
-      cigar = (uint32_t *)((*n_cigar) ? krealloc(km, cigar, (*m_cigar) << 2)
-                                      : kmalloc(km, (*m_cigar) << 2));
+      // the CIGAR is returned to the caller, so it never comes from km
+      cigar = (uint32_t *)((*n_cigar) ? seq_realloc(cigar, (*m_cigar) << 2)
+                                      : seq_alloc_atomic((*m_cigar) << 2));
     }
     cigar[(*n_cigar)++] = len << 4 | op;
   } else
@@ -205,12 +214,13 @@ static inline void ksw_backtrack(
   *m_cigar_ = m_cigar, *n_cigar_ = n_cigar, *cigar_ = cigar;
 }
 
+// ez->cigar and ez->m_cigar are kept so that a CIGAR buffer can be reused
+// across calls; callers set them (to nullptr and 0 for a fresh buffer).
 static inline void ksw_reset_extz(ksw_extz_t *ez) {
   ez->max_q = ez->max_t = ez->mqe_t = ez->mte_q = -1;
   ez->max = 0;
   ez->score = ez->mqe = ez->mte = KSW_NEG_INF;
-  ez->cigar = nullptr;
-  ez->n_cigar = ez->m_cigar = 0;
+  ez->n_cigar = 0;
   ez->zdropped = 0;
   ez->reach_end = 0;
 }